@@ -0,0 +1,12 @@
+// Constant folding: every initializer is a foldable tree
+int main() {
+    int a = 5 + 4 * 5;
+    int b = (a - 5) * (3 + 7) / 2;
+    int c = ((1 << 4) | (1 << 2)) & 0 + 255;
+    int d = (100 - 3 * (2 + 8)) % 7;
+    int e = ~0 ^ (12 >> 2);
+    float f = 1.5 * 4.0 + 0.25;
+    bool g = (3 < 4) && (10 != 11) || !(2 == 2);
+    int h = a * 2 + b * 3 + c * 4 + d * 5 + e * 6;
+    return h;
+}
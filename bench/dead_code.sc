@@ -0,0 +1,16 @@
+// Dead code elimination: most assignments are never read
+int main() {
+    int used = 1;
+    int unused0 = 2;
+    int unused1 = unused0 + 3;
+    int unused2 = unused1 * unused0;
+    int x = used + 2;
+    int y = 5;
+    y = 6;
+    y = 7;
+    int z = x * 3;
+    int w = z + y;
+    return x;
+    int after = 10;
+    after = after + 1;
+}
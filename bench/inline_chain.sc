@@ -0,0 +1,16 @@
+// Function inlining: a chain of small helpers that should collapse into main
+int sq(int a) { return a * a; }
+int add(int a, int b) { return a + b; }
+int addSq(int a, int b) { return add(sq(a), sq(b)); }
+int dist2(int x0, int y0, int x1, int y1) { return addSq(x1 - x0, y1 - y0); }
+int scale(int v, int k) { return v * k; }
+int scaledDist(int x0, int y0, int x1, int y1, int k) { return scale(dist2(x0, y0, x1, y1), k); }
+
+int main() {
+    int total = 0;
+    total = total + scaledDist(0, 0, 3, 4, 2);
+    total = total + scaledDist(1, 1, 4, 5, 3);
+    total = total + scaledDist(2, 2, 5, 6, 4);
+    total = total + addSq(add(1, 2), add(3, 4));
+    return total;
+}
@@ -0,0 +1,15 @@
+// Loop-invariant code motion: the marked expressions don't change inside the loop
+int main() {
+    int n = 1000;
+    int a = 7;
+    int b = 9;
+    int sum = 0;
+    int arr[1000];
+    for (int i = 0; i < n; i++) {
+        int k = a * b; // invariant
+        int m = k + a; // invariant
+        arr[i] = i + m;
+        sum += arr[i];
+    }
+    return sum;
+}
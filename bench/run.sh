@@ -0,0 +1,113 @@
+#!/bin/sh
+# Optimizer benchmark: compiles every bench/*.sc at -O0..-O3 and reports per phase compile time and token counts.
+# Usage: bench/run.sh [--save | --against <old sc_opt>] [sc_opt path]
+#   --save     write the results to bench/baseline.txt instead of comparing against it
+#   --against  time <old sc_opt> in the same rounds (batch by batch, alternating) and compare against it instead of the
+#              times in baseline.txt. Use it on shared or throttled machines, where speed drifts by more than THRESHOLD
+#              over minutes and a stored baseline can't tell a regression from a slow afternoon.
+# Each file is passed REPS times in one invocation (batch mode), so one sample is ~10 ms of work rather than a few us.
+# Every batch runs SAMPLES times and the fastest sample is kept per row (min-of-N: noise only ever adds time). Samples go
+# round all programs and levels, so a slow stretch of the machine hits every row a little instead of a few rows a lot.
+# Regressions: any phase (or the total) more than THRESHOLD percent slower than the baseline, or a token count that changed.
+# The read phase is shown but not flagged, it is a few syscalls per file and swings +-50% with the kernel (it counts in total).
+# A flagged run measures SAMPLES more, up to RETRIES times, and keeps the minimum over all of them. A real regression stays
+# flagged, a busy machine goes away. --save measures SAMPLES * RETRIES so the baseline is close to the true minimum.
+# Execution time of the optimized program will be added once there is an interpreter or emitted code to run.
+
+REPS=${REPS:-1000}
+SAMPLES=${SAMPLES:-15}
+RETRIES=${RETRIES:-3}
+THRESHOLD=${THRESHOLD:-15}
+DIR=$(cd "$(dirname "$0")" && pwd)
+SAVE=0
+AGAINST=""
+if [ "$1" = "--save" ]; then SAVE=1; shift; fi
+if [ "$1" = "--against" ]; then AGAINST=$2; shift 2; fi
+SC_OPT=${1:-$DIR/../sc_opt}
+BASELINE=$DIR/baseline.txt
+RAW=$(mktemp)
+RESULTS=$(mktemp)
+AGAINST_RESULTS=$(mktemp)
+trap 'rm -f "$RAW" "$RESULTS" "$AGAINST_RESULTS"' EXIT
+
+for binary in "$SC_OPT" ${AGAINST:+"$AGAINST"}; do
+    if [ ! -x "$binary" ]; then
+        echo "sc_opt not found at $binary (build it first, see README)" >&2
+        exit 2
+    fi
+done
+
+# Appends SAMPLES samples of every program and level (of both binaries with --against) to $RAW
+measure() {
+    sample=0
+    while [ $sample -lt "$SAMPLES" ]; do
+        for file in "$DIR"/*.sc; do
+            name=$(basename "$file" .sc)
+            args=""
+            i=0
+            while [ $i -lt "$REPS" ]; do args="$args $file"; i=$((i + 1)); done
+            for level in 0 1 2 3; do
+                tag=new
+                for binary in "$SC_OPT" ${AGAINST:+"$AGAINST"}; do
+                    # shellcheck disable=SC2086
+                    "$binary" -O$level --stats-json $args 2>&1 >/dev/null | awk -v tag="$tag" -v name="$name" -v level="$level" -v reps="$REPS" '
+                        /"tokens":/ { match($0, /"tokens": [0-9]+/); tokens = substr($0, RSTART + 10, RLENGTH - 10) / reps }
+                        /"name":/ {
+                            match($0, /"name": "[^"]*"/); phase = substr($0, RSTART + 9, RLENGTH - 10)
+                            match($0, /"nanos": [0-9]+/); nanos = substr($0, RSTART + 9, RLENGTH - 9)
+                            total += nanos
+                            printf "%s\t%s\t-O%s\t%s\t%.2f\n", tag, name, level, phase, nanos / reps / 1000
+                        }
+                        END {
+                            printf "%s\t%s\t-O%s\ttotal\t%.2f\n", tag, name, level, total / reps / 1000
+                            printf "%s\t%s\t-O%s\ttokens\t%d\n", tag, name, level, tokens
+                        }'
+                    tag=old
+                done
+            done
+        done
+        sample=$((sample + 1))
+    done >> "$RAW"
+    awk -F '\t' -v results="$RESULTS" -v against="$AGAINST_RESULTS" '
+        { key = $1 "\t" $2 "\t" $3 "\t" $4 }
+        !(key in best) { order[++count] = key; row[count] = $2 "\t" $3 "\t" $4; tags[count] = $1 }
+        !(key in best) || ($4 != "tokens" && $5 + 0 < best[key] + 0) { best[key] = $5 }
+        END { for (i = 1; i <= count; i++) printf "%s\t%s\n", row[i], best[order[i]] > (tags[i] == "new" ? results : against) }
+    ' "$RAW"
+}
+
+# Prints the comparison table when $1 is 1, exits 1 if anything regressed
+compare() {
+    awk -F '\t' -v threshold="$THRESHOLD" -v basefile="$BASEFILE" -v show="$1" '
+        FILENAME == basefile { base[$1 "\t" $2 "\t" $3] = $4; next }
+        {
+            key = $1 "\t" $2 "\t" $3
+            old = (key in base) ? base[key] : ""
+            change = ""; flag = ""
+            if (old != "" && old > 0) {
+                change = sprintf("%+.1f%%", 100 * ($4 - old) / old)
+                if ($3 == "tokens" ? $4 != old : ($3 != "read" && 100 * ($4 - old) / old > threshold)) { flag = "  REGRESSION"; regressions++ }
+            }
+            if (show) printf "%-18s %-4s %-16s %12s %12s %8s%s\n", $1, $2, $3, $4, old == "" ? "-" : old, change, flag
+        }
+        END { if (regressions) { if (show) printf "%d regression(s) over %s%%\n", regressions, threshold; exit 1 } }
+    ' "$BASEFILE" "$RESULTS"
+}
+
+if [ "$SAVE" = 1 ]; then
+    SAMPLES=$((SAMPLES * RETRIES))
+    measure
+    cp "$RESULTS" "$BASELINE"
+    echo "Saved baseline to $BASELINE"
+    exit 0
+fi
+
+if [ -n "$AGAINST" ]; then BASEFILE=$AGAINST_RESULTS; elif [ -f "$BASELINE" ]; then BASEFILE=$BASELINE; else BASEFILE=/dev/null; fi
+attempt=1
+measure
+while ! compare 0 && [ $attempt -lt "$RETRIES" ]; do
+    measure
+    attempt=$((attempt + 1))
+done
+printf "%-18s %-4s %-16s %12s %12s %8s\n" "Program" "Opt" "Phase" "us/file" "Baseline" "Change"
+compare 1 || exit 1
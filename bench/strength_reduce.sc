@@ -0,0 +1,13 @@
+// Strength reduction / induction variables: i*8 and i*stride become running additions
+int main() {
+    int out[800];
+    int x = 0;
+    int y = 0;
+    int stride = 12;
+    for (int i = 0; i < 100; i++) {
+        x = i * 8;
+        y = i * stride + 4;
+        out[x] = y;
+    }
+    return x + y;
+}
@@ -0,0 +1,16 @@
+// Loop unrolling: fixed trip counts with small bodies
+int main() {
+    int a[64];
+    int b[64];
+    int total = 0;
+    for (int i = 0; i < 64; i++) {
+        a[i] = i;
+    }
+    for (int i = 0; i < 64; i++) {
+        b[i] = a[i] * 2;
+    }
+    for (int i = 0; i < 64; i++) {
+        total += b[i];
+    }
+    return total;
+}
@@ -0,0 +1,113 @@
+/* Optimization Fuel:
+ * Every transform instance calls consumeFuel(pass) first and skips the transform when it returns 0.
+ * Fuel is a global count (-fuel=N) and/or a per pass count (-fuel=<pass>=N), unlimited by default.
+ * Bisecting a miscompile or a slowdown: binary search N with -fuel=N, the first N that shows the problem names the transform
+ * (printed when fuel runs out). Use -j 1 so the transform order is the same every run.
+ * Budgets bound one function: a wall clock limit and an IR growth limit (size relative to where the function started).
+ * A pass that sees budgetExceeded() stops transforming that function, later cheap passes still run.
+*/
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "sc_token.h"
+
+#define UNLIMITED -1
+
+static _Atomic long globalFuel = UNLIMITED;
+static _Atomic long passFuel[PHASE_COUNT];
+static _Atomic int fuelReported;
+static _Atomic long fuelUsed;
+long budgetMillis = 0; // -fbudget-ms, 0 = no time limit
+int budgetGrowth = 0; // -fbudget-growth, max size in percent of the starting size, 0 = no limit
+
+// Unlimited fuel and no budgets, called before each command line is parsed (more than once under --serve)
+void initFuel(void) {
+    globalFuel = UNLIMITED;
+    for (int p = 0; p < PHASE_COUNT; p++) passFuel[p] = UNLIMITED;
+    fuelReported = 0;
+    fuelUsed = 0;
+    budgetMillis = 0;
+    budgetGrowth = 0;
+}
+
+// Decimal digits only (no sign, spaces or trailing text) and at most max, -1 otherwise
+int parseCount(const char* text, long max, long* value) {
+    if (*text < '0' || *text > '9') return -1;
+    char* end;
+    errno = 0;
+    long amount = strtol(text, &end, 10);
+    if (*end || errno == ERANGE || amount > max) return -1;
+    *value = amount;
+    return 0;
+}
+
+// "N" for all passes or "<pass>=N" for one
+int setFuel(const char* spec) {
+    const char* eq = strchr(spec, '=');
+    long amount;
+    if (parseCount(eq ? eq + 1 : spec, LONG_MAX, &amount)) return -1;
+    if (!eq) {
+        globalFuel = amount;
+        return 0;
+    }
+    for (int p = PHASE_INLINE; p <= PHASE_UNROLL; p++) {
+        if (strlen(phaseNames[p]) == (size_t)(eq - spec) && !strncmp(spec, phaseNames[p], eq - spec)) {
+            passFuel[p] = amount;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Take one unit from the pass and the global count, 0 if either is out
+static int takeFuel(_Atomic long* fuel) {
+    long left = atomic_load(fuel);
+    while (left != UNLIMITED) {
+        if (left == 0) return 0;
+        if (atomic_compare_exchange_weak(fuel, &left, left - 1)) return 1;
+    }
+    return 1;
+}
+
+static void giveFuel(_Atomic long* fuel) {
+    if (atomic_load(fuel) != UNLIMITED) atomic_fetch_add(fuel, 1);
+}
+
+int consumeFuel(enum Phase pass) {
+    if (!takeFuel(&globalFuel)) {
+        if (!atomic_exchange(&fuelReported, 1)) fprintf(stderr, "Optimization fuel: none left, first skipped transform is %s in %s\n", phaseNames[pass], currentFile ? currentFile : "?");
+        return 0;
+    }
+    if (!takeFuel(&passFuel[pass])) {
+        giveFuel(&globalFuel);
+        return 0;
+    }
+    long used = atomic_fetch_add(&fuelUsed, 1) + 1;
+    if (atomic_load(&globalFuel) == 0 && !atomic_exchange(&fuelReported, 1)) {
+        fprintf(stderr, "Optimization fuel: transform #%ld (the last one allowed) is %s in %s\n", used, phaseNames[pass], currentFile ? currentFile : "?");
+    }
+    return 1;
+}
+
+static uint64_t nowMillis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Start a function's budget, size is its IR size (tokens or nodes) before optimization
+struct Budget budgetBegin(size_t size) {
+    struct Budget budget = { .deadline = 0, .maxSize = 0 };
+    if (budgetMillis) budget.deadline = nowMillis() + budgetMillis;
+    if (budgetGrowth) budget.maxSize = size * budgetGrowth / 100;
+    return budget;
+}
+
+int budgetExceeded(const struct Budget* budget, size_t size) {
+    if (budget->maxSize && size > budget->maxSize) return 1;
+    if (budget->deadline && nowMillis() > budget->deadline) return 1;
+    return 0;
+}
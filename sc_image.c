@@ -0,0 +1,250 @@
+/* Token Image:
+ * Versioned binary format for a lexed file so it can be cached or shipped between build machines without relexing.
+ * Layout: ImageHeader | ImageSectionEntry[sectionCount] | sections (each 8 byte aligned)
+ * Nothing in the file is a pointer, tokens store an offset into the source section, so the file can be mapped anywhere and used as is.
+ * The section table lets a reader find a section without walking the ones before it. Each entry has its own checksum, checked when the section
+ * is first used, so loading touches two small blocks and a reader only pages in the sections it uses.
+ * Future sections (symbol table, AST node arrays, per-function bodies) get a new ImageSection kind, old readers skip kinds they don't know.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "sc_token.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+#define SECTION_COUNT 4
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+int writeTokenImage(const char* fileName, struct TokenBuffer* tb, unsigned long long cacheKey) {
+    if (!tb->buf || !tb->src) return -1;
+
+    size_t srcSize = strlen(tb->src) + 1; // Keep '\0' so src can be used as a C string
+    if (srcSize > NO_LEXEME || tb->literals.dataSize > UINT32_MAX) { // Offsets are stored as uint32_t, NO_LEXEME is taken
+        fprintf(stderr, "Source too large for a token image (4 GiB max)\n");
+        return -1;
+    }
+    size_t tokensSize = tb->count * sizeof(struct PackedToken);
+    struct PackedToken* packed = malloc(tokensSize ? tokensSize : 1);
+    if (!packed) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    statsAlloc(PHASE_IMAGE, tokensSize ? tokensSize : 1);
+
+    struct LiteralPool* pool = &tb->literals;
+    size_t literalsSize = pool->count * sizeof(struct PackedLiteral);
+    struct PackedLiteral* literals = malloc(literalsSize ? literalsSize : 1);
+    if (!literals) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(packed);
+        return -1;
+    }
+    statsAlloc(PHASE_IMAGE, literalsSize ? literalsSize : 1);
+    for (int id = 0; id < pool->count; id++) {
+        literals[id] = (struct PackedLiteral){ .offset = (uint32_t)pool->offsets[id], .length = (uint32_t)pool->lengths[id] };
+    }
+
+    for (size_t i = 0; i < tb->count; i++) {
+        struct Token* token = &tb->buf[i];
+        struct PackedToken p = { .val = token->val, .type = token->type, .line = token->line, .col = token->col, .length = token->length, .literalId = token->literalId };
+        p.lexemeOffset = token->lexeme ? (uint32_t)(token->lexeme - tb->src) : NO_LEXEME;
+        packed[i] = p;
+    }
+
+    struct ImageSectionEntry sections[SECTION_COUNT] = { 0 };
+    uint64_t offset = alignUp(sizeof(struct ImageHeader) + sizeof(sections));
+    sections[0] = (struct ImageSectionEntry){ .kind = SECTION_SRC, .offset = offset, .size = srcSize };
+    offset = alignUp(offset + srcSize);
+    sections[1] = (struct ImageSectionEntry){ .kind = SECTION_TOKENS, .offset = offset, .size = tokensSize };
+    offset = alignUp(offset + tokensSize);
+    sections[2] = (struct ImageSectionEntry){ .kind = SECTION_LITERAL_INDEX, .offset = offset, .size = literalsSize };
+    offset = alignUp(offset + literalsSize);
+    sections[3] = (struct ImageSectionEntry){ .kind = SECTION_LITERAL_DATA, .offset = offset, .size = pool->dataSize };
+    uint64_t fileSize = offset + pool->dataSize;
+
+    // Build the whole file in memory, then checksum each section where it ends up
+    char* image = calloc(1, fileSize);
+    if (!image) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(packed); free(literals);
+        return -1;
+    }
+    statsAlloc(PHASE_IMAGE, fileSize);
+    memcpy(image + sections[0].offset, tb->src, srcSize);
+    memcpy(image + sections[1].offset, packed, tokensSize);
+    memcpy(image + sections[2].offset, literals, literalsSize);
+    if (pool->dataSize) memcpy(image + sections[3].offset, pool->data, pool->dataSize);
+    free(packed); free(literals);
+
+    for (int i = 0; i < SECTION_COUNT; i++) sections[i].checksum = hashBytes(image + sections[i].offset, sections[i].size, FNV_OFFSET);
+    memcpy(image + sizeof(struct ImageHeader), sections, sizeof(sections));
+    struct ImageHeader header = { .magic = SC_IMAGE_MAGIC, .version = SC_IMAGE_VERSION, .sectionCount = SECTION_COUNT, .cacheKey = cacheKey };
+    header.checksum = hashBytes((const char*)&header.cacheKey, sizeof(header.cacheKey), FNV_OFFSET);
+    header.checksum = hashBytes((const char*)sections, sizeof(sections), header.checksum);
+    memcpy(image, &header, sizeof(header));
+
+    FILE* file = fopen(fileName, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening file\n");
+        free(image);
+        return -1;
+    }
+    size_t written = fwrite(image, 1, fileSize, file);
+    fclose(file);
+    free(image);
+    return written == fileSize ? 0 : -1;
+}
+
+static void* mapFile(const char* fileName, size_t* sizePtr) {
+#ifdef HAVE_MMAP
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) { close(fd); return NULL; }
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    *sizePtr = st.st_size;
+    return base;
+#else
+    FILE* file = fopen(fileName, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    rewind(file);
+    void* base = fileSize > 0 ? malloc(fileSize) : NULL;
+    if (base && fread(base, 1, fileSize, file) != (size_t)fileSize) { free(base); base = NULL; }
+    fclose(file);
+    *sizePtr = fileSize;
+    return base;
+#endif
+}
+
+void freeTokenImage(struct TokenImage* image) {
+    if (!image->base) return;
+#ifdef HAVE_MMAP
+    munmap(image->base, image->size);
+#else
+    free(image->base);
+#endif
+    image->base = NULL;
+}
+
+static struct TokenImage invalidImage(struct TokenImage* image) {
+    fprintf(stderr, "Invalid or corrupt token image\n");
+    freeTokenImage(image);
+    image->sections = NULL; image->sectionCount = 0;
+    return *image;
+}
+
+// Only the header and the section table are read here, sections are checked by useSection()
+struct TokenImage loadTokenImage(const char* fileName) {
+    struct TokenImage image = { .base = NULL, .sections = NULL, .sectionCount = 0, .verified = 0 };
+    image.base = mapFile(fileName, &image.size);
+    if (!image.base) {
+        fprintf(stderr, "Error opening file\n");
+        return image;
+    }
+
+    const char* bytes = image.base;
+    struct ImageHeader header;
+    if (image.size < sizeof(header)) return invalidImage(&image);
+    memcpy(&header, bytes, sizeof(header));
+    if (header.magic != SC_IMAGE_MAGIC || header.version != SC_IMAGE_VERSION) return invalidImage(&image);
+    if (header.sectionCount > (image.size - sizeof(header)) / sizeof(struct ImageSectionEntry)) return invalidImage(&image);
+    const struct ImageSectionEntry* sections = (const struct ImageSectionEntry*)(bytes + sizeof(header));
+    uint64_t checksum = hashBytes((const char*)&header.cacheKey, sizeof(header.cacheKey), FNV_OFFSET);
+    if (hashBytes((const char*)sections, header.sectionCount * sizeof(struct ImageSectionEntry), checksum) != header.checksum) return invalidImage(&image);
+
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        if (sections[i].offset > image.size || sections[i].size > image.size - sections[i].offset || sections[i].offset % 8) return invalidImage(&image);
+    }
+    image.sections = sections;
+    image.sectionCount = header.sectionCount;
+    image.cacheKey = header.cacheKey;
+    return image;
+}
+
+static const struct ImageSectionEntry* findSection(const struct TokenImage* image, enum ImageSection kind) {
+    for (uint32_t i = 0; i < image->sectionCount; i++) {
+        if (image->sections[i].kind == kind) return &image->sections[i];
+    }
+    return NULL;
+}
+
+static uint64_t sectionSize(const struct TokenImage* image, enum ImageSection kind) {
+    const struct ImageSectionEntry* entry = findSection(image, kind);
+    return entry ? entry->size : 0;
+}
+
+// Range checks that need only the section table for the other sections' sizes, not their bytes
+static int checkSection(const struct TokenImage* image, enum ImageSection kind, const char* bytes, uint64_t size) {
+    if (kind == SECTION_SRC) return size > 0 && bytes[size - 1] == '\0';
+    if (kind == SECTION_TOKENS) {
+        if (size % sizeof(struct PackedToken)) return 0;
+        uint64_t srcLength = sectionSize(image, SECTION_SRC) ? sectionSize(image, SECTION_SRC) - 1 : 0; // Without the '\0'
+        uint64_t literalCount = sectionSize(image, SECTION_LITERAL_INDEX) / sizeof(struct PackedLiteral);
+        const struct PackedToken* tokens = (const struct PackedToken*)bytes;
+        for (size_t i = 0; i < size / sizeof(struct PackedToken); i++) {
+            if (tokens[i].length < 0) return 0;
+            if (tokens[i].lexemeOffset != NO_LEXEME && (tokens[i].lexemeOffset > srcLength || (uint64_t)tokens[i].length > srcLength - tokens[i].lexemeOffset)) return 0;
+            if (tokens[i].type == STR_LITERAL && (tokens[i].literalId < 0 || (uint64_t)tokens[i].literalId >= literalCount)) return 0;
+        }
+    }
+    if (kind == SECTION_LITERAL_INDEX) {
+        if (size % sizeof(struct PackedLiteral)) return 0;
+        uint64_t dataSize = sectionSize(image, SECTION_LITERAL_DATA);
+        const struct PackedLiteral* literals = (const struct PackedLiteral*)bytes;
+        for (size_t i = 0; i < size / sizeof(struct PackedLiteral); i++) {
+            if ((uint64_t)literals[i].offset + literals[i].length >= dataSize) return 0; // Room for the '\0' after it
+        }
+    }
+    return 1;
+}
+
+// A section's bytes, its checksum and ranges are checked on first use. NULL if it is missing or corrupt.
+static const char* useSection(struct TokenImage* image, enum ImageSection kind, uint64_t* size) {
+    const struct ImageSectionEntry* entry = findSection(image, kind);
+    if (!entry) return NULL;
+    const char* bytes = (const char*)image->base + entry->offset;
+    if (!(image->verified & (1u << kind))) {
+        if (hashBytes(bytes, entry->size, FNV_OFFSET) != entry->checksum || !checkSection(image, kind, bytes, entry->size)) {
+            fprintf(stderr, "Invalid or corrupt token image section %d\n", kind);
+            return NULL;
+        }
+        image->verified |= 1u << kind;
+    }
+    *size = entry->size;
+    return bytes;
+}
+
+const char* imageSource(struct TokenImage* image) {
+    uint64_t size;
+    return useSection(image, SECTION_SRC, &size);
+}
+
+const struct PackedToken* imageTokens(struct TokenImage* image, size_t* count) {
+    uint64_t size;
+    const char* bytes = useSection(image, SECTION_TOKENS, &size);
+    *count = bytes ? size / sizeof(struct PackedToken) : 0;
+    return (const struct PackedToken*)bytes;
+}
+
+const char* imageLiteral(struct TokenImage* image, int id, int* length) {
+    uint64_t indexSize, dataSize;
+    const char* index = useSection(image, SECTION_LITERAL_INDEX, &indexSize);
+    const char* data = index ? useSection(image, SECTION_LITERAL_DATA, &dataSize) : NULL;
+    if (!data || id < 0 || (uint64_t)id >= indexSize / sizeof(struct PackedLiteral)) return NULL;
+    const struct PackedLiteral* literal = (const struct PackedLiteral*)index + id;
+    *length = literal->length;
+    return data + literal->offset;
+}
@@ -12,18 +12,28 @@
 #include <ctype.h>
 #include <string.h>
 #include "sc_token.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define MAX_KEYWORD_LEN 8
+#define READ_CHUNK (64 * 1024) // First read size for inputs that can't be sized (stdin, pipes)
 
 static const char* validTripleOps[] = { "<<=", ">>=" }; int validTripleOpsSize = sizeof(validTripleOps)/sizeof(validTripleOps[0]);
 static const char* validDoubleOps[] = { "==", "<=", ">=", "!=", "&&", "||", "++", "--", "+=", "-=", "*=", "%=", "&=", "|=", "^=", "<<", ">>", "->" }; int validDoubleOpsSize = sizeof(validDoubleOps)/sizeof(validDoubleOps[0]);
 static const char validSingleOps[] = "+-*%=<>!&|~^.(){}[];,"; int validSingleOpsSize = sizeof(validSingleOps)/sizeof(validSingleOps[0]);
 static const char* validKeywords[] = { "int", "float", "char", "bool", "void", "if", "else", "for", "while", "break", "continue", "return", "const", "static", "nullptr", "NULL" }; int validKeywordsSize = sizeof(validKeywords)/sizeof(validKeywords[0]);
-static struct TokenBuffer tb;
+static _Thread_local struct TokenBuffer tb; // Per thread so files can be lexed concurrently (-j)
 
 int strInArray(const char* str, const char* arr[], int arrSize);
 int charInArray(char c, const char* arr, int arrSize);
 void scanForTokens(char** bpPtr, int* colPtr, int line);
 void emitToken(struct Token* token);
+static char decodeChar(const char** inPtr, const char* end);
+static int internLiteral(struct LiteralPool* pool, const char* text, int length);
 
 struct Token scanFunction(char** bpPtr, char* start, int* colPtr, int startCol, int line) {
     int bracketDepth = 1;
@@ -42,7 +52,8 @@ struct Token scanFunction(char** bpPtr, char* start, int* colPtr, int startCol,
                 struct Token emptyToken = { .type = EMPTY, .line = line, .col = *colPtr, .lexeme = NULL, .length = 0 };
                 return emptyToken; // EOF
             }
-            (*bpPtr)++; (*colPtr)++; 
+            size_t skip = 1 + strcspn(*bpPtr + 1, isString ? "\"" : "'"); // Only the closing quote (or '\0') matters inside a literal
+            (*bpPtr) += skip; (*colPtr) += skip;
             continue; 
         }
         if (**bpPtr == '\0') {
@@ -59,15 +70,19 @@ struct Token scanFunction(char** bpPtr, char* start, int* colPtr, int startCol,
                 break;
             }
         }
-        (*bpPtr)++; (*colPtr)++;
+        size_t skip = 1 + strcspn(*bpPtr + 1, "()\"'"); // Jump to the next bracket or quote
+        (*bpPtr) += skip; (*colPtr) += skip;
     }
     struct Token functionToken = { .type = FUNCTION, .line = line, .col = startCol, .lexeme = start, .length = (*bpPtr + 1) - start};
 
     char* inner = argsStart;
     int dummyCol = *colPtr;
+    char closing = argsEnd[1];
+    argsEnd[1] = '\0'; // End the source at the ')' for now, so an unclosed array or literal in the args can't scan past the call
     while (inner <= argsEnd) {
         scanForTokens(&inner, &dummyCol, line);
     }
+    argsEnd[1] = closing;
     *bpPtr = argsEnd + 2;
     *colPtr += 2;
 
@@ -208,7 +223,7 @@ struct Token scanCharLiteral(char** bpPtr, int* colPtr, int line) {
     (*bpPtr)++; (*colPtr)++; // Consume '
 
     while ((**bpPtr) != '\'') {
-        if ((**bpPtr) == '\0') {
+        if ((**bpPtr) == '\0' || ((**bpPtr) == '\\' && *(*bpPtr + 1) == '\0')) { // Unterminated (a lone '\' would skip the '\0')
             struct Token emptyToken = { .type = EMPTY, .line = line, .col = startCol, .lexeme = NULL, .length = 0};
             return emptyToken;
         }
@@ -221,7 +236,9 @@ struct Token scanCharLiteral(char** bpPtr, int* colPtr, int line) {
         char* end = *bpPtr;
         int length = end - start;
 
-        struct Token charToken = { .type = CHAR_LITERAL, .line = line, .col = startCol, .lexeme = start, .length = length };
+        const char* text = start + 1;
+        float value = length > 2 ? (unsigned char)decodeChar(&text, end - 1) : 0; // Decoded once here, folding compares val
+        struct Token charToken = { .type = CHAR_LITERAL, .line = line, .col = startCol, .val = value, .lexeme = start, .length = length };
         return charToken;
     }
     struct Token emptyToken = { .type = EMPTY, .line = line, .col = *colPtr, .lexeme = NULL, .length = 0 };
@@ -235,12 +252,13 @@ struct Token scanStrLiteral(char** bpPtr, int* colPtr, int line) {
     (*bpPtr)++; (*colPtr)++; // Consume "
 
     while ((**bpPtr) != '\"') {
-        if ((**bpPtr) == '\0') {
+        size_t skip = strcspn(*bpPtr, "\"\\"); // Jump to the next quote, escape or '\0'
+        (*bpPtr) += skip; (*colPtr) += skip;
+        if ((**bpPtr) == '\0' || ((**bpPtr) == '\\' && *(*bpPtr + 1) == '\0')) {
             struct Token emptyToken = { .type = EMPTY, .line = line, .col = startCol, .lexeme = NULL, .length = 0};
             return emptyToken;
         }
-        else if ((**bpPtr) == '\\') { (*bpPtr)++; (*colPtr)++; }
-        (*bpPtr)++; (*colPtr)++;
+        else if ((**bpPtr) == '\\') { (*bpPtr) += 2; (*colPtr) += 2; } // Skip escape + escaped char
     }
     (*bpPtr)++; (*colPtr)++; // Skip closing "
 
@@ -248,7 +266,8 @@ struct Token scanStrLiteral(char** bpPtr, int* colPtr, int line) {
         char* end = *bpPtr;
         int length = end - start;
         
-        struct Token strToken = { .type = STR_LITERAL, .line = line, .col = startCol, .lexeme = start, .length = length };
+        int id = internLiteral(&tb.literals, start + 1, length - 2); // Between the quotes
+        struct Token strToken = { .type = STR_LITERAL, .line = line, .col = startCol, .lexeme = start, .length = length, .literalId = id };
         return strToken;
     }
     struct Token emptyToken = { .type = EMPTY, .line = line, .col = *colPtr, .lexeme = NULL, .length = 0 };
@@ -256,7 +275,7 @@ struct Token scanStrLiteral(char** bpPtr, int* colPtr, int line) {
 }
 
 struct Token scanFloatLiteral(char** bpPtr, char* start, int* colPtr, int startCol, int line) {
-    (*bpPtr)++; *(colPtr)++; // Move past the . to avoid infinite loop
+    (*bpPtr)++; (*colPtr)++; // Move past the . to avoid infinite loop
     while (isdigit(**bpPtr)) { // While we are reading digits, add them to the token
         (*bpPtr)++; (*colPtr)++; 
     } 
@@ -304,19 +323,205 @@ struct Token scanIntLiteral(char** bpPtr, int* colPtr, int line) {
     return emptyToken; // No integer literal found
 }
 
+// Set when emitting a token or interning a literal runs out of memory. The lexer runs inside the --serve process, so it fails
+// the file instead of exiting: lexLoop stops at the next token and lexFile / relexEdit check it once the buffer is complete.
+static _Thread_local int outOfMemory;
+
+static int initTokens(size_t capacity) {
+    outOfMemory = 0;
+    tb.count = 0;
+    tb.capacity = capacity;
+    tb.buf = malloc(tb.capacity * sizeof(struct Token));
+    if (!tb.buf) return -1;
+    statsAlloc(PHASE_LEX, tb.capacity * sizeof(struct Token));
+    return 0;
+}
+
 void emitToken(struct Token* token) {
-    if (tb.count == tb.capacity) {
-        tb.capacity *= 2;
-        struct Token* temp = realloc(tb.buf, tb.capacity * sizeof(struct Token));
+    if (tb.count == tb.capacity) { // Big arrays are mremap'd by realloc, not copied: 50M tokens spend 8 ms of 3.9 s here
+        struct Token* temp = realloc(tb.buf, tb.capacity * 2 * sizeof(struct Token));
         if (!temp) {
-            fprintf(stderr, "Memory reallocation failed!\n");
-            exit(1);
+            outOfMemory = 1; // The token is dropped, lexLoop stops and the lex fails
+            return;
         }
         tb.buf = temp;
+        tb.capacity *= 2;
+        statsAlloc(PHASE_LEX, tb.capacity * sizeof(struct Token));
     }
     tb.buf[tb.count++] = *token;
 }
 
+// FNV-1a, chain calls by passing the previous result as seed (start with FNV_OFFSET)
+unsigned long long hashBytes(const char* bytes, size_t length, unsigned long long seed) {
+    unsigned long long hash = seed;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Hash of SC_VERSION + the source bytes, computed on demand (it reads the whole source) for callers that need a cache key
+unsigned long long sourceHash(const struct TokenBuffer* tb) {
+    unsigned long long hash = hashBytes(SC_VERSION, strlen(SC_VERSION), FNV_OFFSET);
+    return hashBytes(tb->src, strlen(tb->src), hash);
+}
+
+// Decode one (possibly escaped) character at *inPtr, advancing past it
+static char decodeChar(const char** inPtr, const char* end) {
+    const char* in = *inPtr;
+    char c = *in++;
+    if (c == '\\' && in < end) {
+        c = *in++;
+        switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'a': c = '\a'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'v': c = '\v'; break;
+            case 'x': { // \xHH
+                int value = 0;
+                while (in < end && isxdigit(*in)) { value = value * 16 + (isdigit(*in) ? *in - '0' : (tolower(*in) - 'a' + 10)); in++; }
+                c = (char)value;
+                break;
+            }
+            case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': { // \ooo, up to 3 digits
+                int value = c - '0';
+                for (int i = 0; i < 2 && in < end && *in >= '0' && *in <= '7'; i++) value = value * 8 + (*in++ - '0');
+                c = (char)value;
+                break;
+            }
+            default: break; // \\ \' \" and unknown escapes are the char itself
+        }
+    }
+    *inPtr = in;
+    return c;
+}
+
+static int growLiterals(struct LiteralPool* pool, size_t extraBytes) {
+    if (pool->dataSize + extraBytes > pool->dataCapacity) {
+        size_t capacity = pool->dataCapacity ? pool->dataCapacity * 2 : 256;
+        while (capacity < pool->dataSize + extraBytes) capacity *= 2;
+        char* temp = realloc(pool->data, capacity);
+        if (!temp) return -1;
+        pool->data = temp; pool->dataCapacity = capacity;
+        statsAlloc(PHASE_LEX, capacity);
+    }
+    if (pool->count == pool->capacity) {
+        int capacity = pool->capacity ? pool->capacity * 2 : 16;
+        size_t* offsets = realloc(pool->offsets, capacity * sizeof(size_t));
+        if (offsets) pool->offsets = offsets;
+        int* lengths = realloc(pool->lengths, capacity * sizeof(int));
+        if (lengths) pool->lengths = lengths;
+        if (!offsets || !lengths) return -1;
+        pool->capacity = capacity;
+        statsAlloc(PHASE_LEX, capacity * sizeof(size_t));
+        statsAlloc(PHASE_LEX, capacity * sizeof(int));
+    }
+    if (pool->count * 2 >= (int)pool->tableSize) { // Keep the table under half full, rehash into a bigger one
+        size_t tableSize = pool->tableSize ? pool->tableSize * 2 : 32;
+        int* table = calloc(tableSize, sizeof(int));
+        if (!table) return -1;
+        statsAlloc(PHASE_LEX, tableSize * sizeof(int));
+        for (int id = 0; id < pool->count; id++) {
+            size_t slot = hashBytes(pool->data + pool->offsets[id], pool->lengths[id], FNV_OFFSET) & (tableSize - 1);
+            while (table[slot]) slot = (slot + 1) & (tableSize - 1);
+            table[slot] = id + 1;
+        }
+        free(pool->table);
+        pool->table = table; pool->tableSize = tableSize;
+    }
+    return 0;
+}
+
+// Id of the decoded literal sitting at the end of data, it's kept only if it's new
+static int keepLiteral(struct LiteralPool* pool, int decodedLength) {
+    char* out = pool->data + pool->dataSize;
+    out[decodedLength] = '\0';
+    size_t slot = hashBytes(out, decodedLength, FNV_OFFSET) & (pool->tableSize - 1);
+    while (pool->table[slot]) {
+        int id = pool->table[slot] - 1;
+        if (pool->lengths[id] == decodedLength && !memcmp(pool->data + pool->offsets[id], out, decodedLength)) return id;
+        slot = (slot + 1) & (pool->tableSize - 1);
+    }
+    int id = pool->count++;
+    pool->offsets[id] = pool->dataSize;
+    pool->lengths[id] = decodedLength;
+    pool->dataSize += decodedLength + 1;
+    pool->table[slot] = id + 1;
+    return id;
+}
+
+// Decode the text between the quotes of a string literal and return its id, identical strings share one id
+static int internLiteral(struct LiteralPool* pool, const char* text, int length) {
+    if (growLiterals(pool, length + 1)) {
+        outOfMemory = 1;
+        return -1;
+    }
+    char* out = pool->data + pool->dataSize; // Decode in place at the end of data
+    int decodedLength = 0;
+    const char* end = text + length;
+    while (text < end) out[decodedLength++] = decodeChar(&text, end);
+    return keepLiteral(pool, decodedLength);
+}
+
+const char* literalText(const struct LiteralPool* pool, int id, int* length) {
+    if (id < 0 || id >= pool->count) return NULL;
+    if (length) *length = pool->lengths[id];
+    return pool->data + pool->offsets[id];
+}
+
+void freeLiterals(struct LiteralPool* pool) {
+    free(pool->data); free(pool->offsets); free(pool->lengths); free(pool->table);
+    struct LiteralPool empty = { 0 };
+    *pool = empty;
+}
+
+// Rebuilds tb's pool with only the literals its tokens still use, numbered in order of first use like lexFile() numbers them.
+// Each live literal is hashed once, the tokens only go through an id -> id table.
+static int compactLiterals(void) {
+    struct LiteralPool* pool = &tb.literals;
+    struct LiteralPool live = { 0 };
+    int* remap = malloc((pool->count ? pool->count : 1) * sizeof(int));
+    if (!remap) return -1;
+    statsAlloc(PHASE_LEX, (pool->count ? pool->count : 1) * sizeof(int));
+    for (int id = 0; id < pool->count; id++) remap[id] = -1;
+    for (size_t i = 0; i < tb.count; i++) {
+        struct Token* token = &tb.buf[i];
+        if (token->type != STR_LITERAL) continue;
+        int id = token->literalId;
+        if (remap[id] < 0) {
+            if (growLiterals(&live, pool->lengths[id] + 1)) {
+                free(remap);
+                freeLiterals(&live);
+                return -1;
+            }
+            memcpy(live.data + live.dataSize, pool->data + pool->offsets[id], pool->lengths[id]); // Already decoded
+            remap[id] = keepLiteral(&live, pool->lengths[id]);
+        }
+        token->literalId = remap[id];
+    }
+    free(remap);
+    freeLiterals(pool);
+    *pool = live;
+    return 0;
+}
+
+// Whether the relexed range dropped a string literal: the old range's literals, in order, aren't all found again in the new range.
+// Ids are comparable because the new range interned into the old pool.
+static int droppedLiteral(const struct Token* oldRange, size_t oldCount, const struct Token* newRange, size_t newCount) {
+    size_t i = 0, j = 0;
+    while (1) {
+        while (i < oldCount && oldRange[i].type != STR_LITERAL) i++;
+        while (j < newCount && newRange[j].type != STR_LITERAL) j++;
+        if (i == oldCount) return 0; // Literals only the new range has were interned as it was lexed, they are live
+        if (j == newCount || oldRange[i].literalId != newRange[j].literalId) return 1;
+        i++; j++;
+    }
+}
+
 int strInArray(const char* str, const char* arr[], int arrSize) {
     for (int i = 0; i < arrSize; i++) {
         if (strcmp(str, arr[i]) == 0) return 1;
@@ -358,62 +563,92 @@ void scanForTokens(char** bpPtr, int* colPtr, int line) {
 
     else if (charInArray(**bpPtr, validSingleOps, validSingleOpsSize)) { // Operator or Delimiter
         struct Token opDelimToken = scanOpDelim(bpPtr, colPtr, line);
-        if (opDelimToken.type != END_OF_FILE) emitToken(&opDelimToken); // Emit operator or delimiter token
+        if (opDelimToken.type != EMPTY) emitToken(&opDelimToken); // Emit operator or delimiter token
 
         else { (*bpPtr)++; (*colPtr)++; } // Unknown character; skip
     }
     else { (*bpPtr)++; (*colPtr)++; }
 }
 
-struct TokenBuffer lexFile(char* fileName) {
+#define NO_CALL SIZE_MAX
+
+// Resynchronization state for relexEdit(), NULL when lexing a whole file
+struct Resync {
+    struct Token* oldTokens;
+    size_t oldCount;
+    uintptr_t oldBase; // Address old tokens were lexed at, see tokenStart
+    size_t oldLength;
+    const char* newSrc;
+    size_t editEnd; // End of the inserted text (new src offset)
+    long delta; // new offset - old offset for everything after the edit
+    size_t next; // Next old token to check for resync
+    size_t openCall; // Offset of the outermost call still open before old token next, NO_CALL if none (see trackCalls)
+};
+
+// Offset of a token in the source it was lexed from. base is that source's address as a number: relexEdit() may have moved the
+// source since, the old tokens' lexemes are only compared against it, never read through.
+static size_t tokenStart(struct Token* token, uintptr_t base, size_t srcLength) {
+    return token->lexeme ? (size_t)((uintptr_t)token->lexeme - base) : srcLength; // EOF token has no lexeme
+}
 
-    FILE* file = fopen(fileName, "r");
-    if (!file) {
-        printf("Error opening file\n");
-        return tb;
-    }
-    
-    // Get length of file for buffer allocation
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-    rewind(file);
-
-    if (fileSize <= 0) {
-        printf("Empty file or error reading file size\n");
-        fclose(file);
-        tb.buf = NULL; tb.src = NULL;
-        return tb;
-    }
-    
-    // Allocate buffer for file contents
-    char* buf = malloc(fileSize + 1);
-    tb.capacity = 128;
-    tb.buf = malloc(tb.capacity * sizeof(struct Token));
+// scanFunction() emits a FUNCTION token for the '(' before a call's args. lexLoop never starts a token there (the call starts at its name),
+// and an unclosed call leaves the marker with nothing after it to rule it out, so it is never a cut. Told apart from the call's own
+// FUNCTION token (name through ')', 3 bytes or more) by length, relexEdit() has edited the source old lexemes point into.
+static int isCallMarker(struct Token* token) {
+    return token->type == FUNCTION && token->length == 1;
+}
 
-    if (!buf) {
-        printf("Memory allocation failed\n");
-        fclose(file);
-        tb.buf = NULL; tb.src = NULL;
-        return tb;
-    }
-    else if (!tb.buf) {
-        printf("Memory allocation failed\n");
-        fclose(file);
-        free(buf);
-        tb.buf = NULL; tb.src = NULL;
-        return tb;       
+// Call nesting while walking tokens in order: a call is its marker, the tokens of its args, then the FUNCTION token for the whole
+// call, which starts at the name, before all of them. That token closes every marker at or after its start, including the marker
+// of an unclosed call inside its args (which never gets its own). *openCall is the outermost open marker, NO_CALL at top level.
+static void trackCalls(struct Token* token, size_t start, size_t* openCall) {
+    if (token->type != FUNCTION) return;
+    if (isCallMarker(token)) { if (*openCall == NO_CALL) *openCall = start; }
+    else if (*openCall != NO_CALL && *openCall >= start) *openCall = NO_CALL;
+}
+
+// Where a token sits in the token stream: its start, except for a call's own FUNCTION token, which comes after its args and is
+// placed at its ')'. Increasing along the stream, so relexEdit() can binary search it.
+static size_t tokenKey(struct Token* token, uintptr_t base, size_t srcLength) {
+    size_t start = tokenStart(token, base, srcLength);
+    return token->type == FUNCTION && !isCallMarker(token) ? start + token->length - 1 : start;
+}
+
+// A clean cut at token i > 0: lexLoop started a token there, at top level, so lexing can restart from it. The args of a call are
+// lexed with the line of the call (scanForTokens() takes it by value), so a token on another line than the one before it isn't
+// inside any call. It isn't a call itself either, and the token before it doesn't reach past its start.
+static int isCleanCut(struct Token* tokens, size_t i, uintptr_t base, size_t srcLength) {
+    struct Token* token = &tokens[i];
+    struct Token* previous = &tokens[i - 1];
+    return token->type != FUNCTION && token->line != previous->line &&
+           tokenStart(previous, base, srcLength) + previous->length <= tokenStart(token, base, srcLength);
+}
+
+// Old token index the new lexer has resynchronized with, or -1
+static long checkResync(struct Resync* rs, char* bp) {
+    size_t newPos = bp - rs->newSrc;
+    if (newPos < rs->editEnd) return -1;
+    size_t oldPos = newPos - rs->delta;
+
+    size_t start = tokenStart(&rs->oldTokens[rs->next], rs->oldBase, rs->oldLength);
+    while (rs->next + 1 < rs->oldCount && start < oldPos) {
+        trackCalls(&rs->oldTokens[rs->next], start, &rs->openCall);
+        rs->next++;
+        start = tokenStart(&rs->oldTokens[rs->next], rs->oldBase, rs->oldLength);
     }
-    
-    tb.count = 0;
-    tb.src = buf;
-    
-    size_t bytes = fread(buf, 1, fileSize, file);
-    buf[bytes] = '\0'; // Null-terminate the buffer
-    fclose(file);
+    if (rs->next + 1 >= rs->oldCount) return -1; // Only EOF left, just lex to the end
+    // Old tokens before next all start before oldPos and no call is open, so none of them spans it either
+    if (start != oldPos || rs->oldTokens[rs->next].type == FUNCTION || rs->openCall != NO_CALL) return -1;
+    return rs->next;
+}
 
-    int line = 1, col = 0;
-    char* bp = buf; // Buffer pointer
-    while (*bp) {
+// Main lexing loop. Returns 0 at end of source, 1 if resynchronized (rs->next is the old token to resume from), -1 on error.
+static int lexLoop(char** bpPtr, int* linePtr, int* colPtr, struct Resync* rs) {
+    char* bp = *bpPtr;
+    int line = *linePtr, col = *colPtr;
+    int status = 0;
+    while (*bp && !outOfMemory) {
+        if (rs && checkResync(rs, bp) >= 0) { status = 1; break; }
         if (*bp == ' ' || *bp == '\t' || *bp == '\n') {
             if (*bp == '\n') { line++; bp++; col=0; continue; }
             bp++; col++;
@@ -429,16 +664,19 @@ struct TokenBuffer lexFile(char* fileName) {
             else if (*(bp + 1) && *(bp + 1) == '*') {
                 // Multi-line comment
                 bp += 2; col+=2; // Skip '/*'
-                if (*bp == '\0') { // Unterminated comment
-                    printf("Error: Unterminated comment\n");
-                    free(buf);
-                    return tb;
+                char* end = strstr(bp, "*/"); // libc scans for the closer (and the newlines below) many bytes at a time
+                if (!end) { // Unterminated comment
+                    fprintf(stderr, "Error: Unterminated comment\n");
+                    status = -1;
+                    break;
                 }
-                while (*bp && *(bp+1) && !(*bp == '*'  && *(bp + 1) == '/')) { 
-                    bp++; col++;  
-                    if (*bp == '\n') { line++; col=0; }
+                char* lastNewline = NULL;
+                for (char* nl = memchr(bp, '\n', end - bp); nl; nl = memchr(nl + 1, '\n', end - nl - 1)) {
+                    line++;
+                    lastNewline = nl;
                 }
-                if (*bp) { bp += 2; col+=2; } // Skip '*/'
+                col = lastNewline ? end - (lastNewline + 1) : col + (end - bp);
+                bp = end + 2; col += 2; // Skip '*/'
                 continue;
             } 
             else {
@@ -459,9 +697,249 @@ struct TokenBuffer lexFile(char* fileName) {
             scanForTokens(&bp, &col, line);
         }
     }
+    if (outOfMemory) status = -1; // Reported by the caller, which also checks the tokens it emits after the loop
+    *bpPtr = bp; *linePtr = line; *colPtr = col;
+    return status;
+}
 
+// Reads a stream that can't be sized up front (stdin, pipes, FIFOs) to EOF.
+// The buffer doubles from READ_CHUNK, each fread fills the whole free part so reads stay large and power of two sized.
+static char* readStream(FILE* file, size_t* sizePtr, size_t* allocatedPtr) {
+    size_t capacity = READ_CHUNK, size = 0;
+    char* buf = malloc(capacity + 1); // + 1 for '\0'
+    while (buf) {
+        size += fread(buf + size, 1, capacity - size, file);
+        if (size < capacity) break; // Short read: EOF or error, lexFile checks ferror()
+        char* grown = realloc(buf, capacity * 2 + 1);
+        if (!grown) {
+            free(buf);
+            return NULL;
+        }
+        buf = grown;
+        capacity *= 2;
+    }
+    *sizePtr = size;
+    *allocatedPtr = capacity + 1;
+    return buf;
+}
+
+// Ask the kernel to start reading a file we will lex soon, so its read overlaps with lexing the current one.
+// Only a hint: returns at once, does nothing for stdin or where posix_fadvise is missing.
+void prefetchFile(const char* fileName) {
+#ifdef POSIX_FADV_WILLNEED
+    if (!strcmp(fileName, "-")) return;
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return; // lexFile reports the error when it gets there
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+#else
+    (void)fileName;
+#endif
+}
+
+struct TokenBuffer lexFile(char* fileName) {
+    uint64_t readStart = statsNow();
+    struct LiteralPool emptyPool = { 0 };
+    tb.literals = emptyPool; // The previous file's pool belongs to its caller now
+
+    int fromStdin = !strcmp(fileName, "-");
+    FILE* file = fromStdin ? stdin : fopen(fileName, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening file\n");
+        tb.buf = NULL; tb.src = NULL; // Don't hand back the previous file's buffers
+        return tb;
+    }
+    
+    // Get length of file for buffer allocation, pipes, FIFOs and anything else that isn't a regular file are read until EOF instead
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    long fileSize = (!fstat(fileno(file), &st) && S_ISREG(st.st_mode)) ? (long)st.st_size : -1;
+#else
+    long fileSize = fseek(file, 0, SEEK_END) ? -1 : ftell(file);
+#endif
+    size_t allocated = 0, bytes = 0;
+    char* buf = NULL;
+    if (fileSize < 0) {
+        buf = readStream(file, &bytes, &allocated);
+    }
+    else if (fileSize > 0) {
+        rewind(file);
+        allocated = fileSize + 1;
+        buf = malloc(allocated);
+        if (buf) bytes = fread(buf, 1, fileSize, file);
+    }
+    int readFailed = ferror(file); // A short read is EOF or an error (EIO, EISDIR, EINTR under --serve), only this tells
+    if (!fromStdin) fclose(file);
+
+    if (!buf && fileSize != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        tb.buf = NULL; tb.src = NULL;
+        return tb;
+    }
+    if (readFailed) {
+        fprintf(stderr, "Error reading file\n");
+        free(buf);
+        tb.buf = NULL; tb.src = NULL;
+        return tb;
+    }
+    if (bytes == 0) {
+        fprintf(stderr, "Empty file or error reading file\n");
+        free(buf);
+        tb.buf = NULL; tb.src = NULL;
+        return tb;
+    }
+    buf[bytes] = '\0'; // Null-terminate the buffer
+
+    if (initTokens(128)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(buf);
+        tb.buf = NULL; tb.src = NULL;
+        return tb;       
+    }
+    
+    tb.src = buf;
+    statsEnd(PHASE_READ, readStart);
+    statsAlloc(PHASE_READ, allocated);
+    threadStats.srcBytes += bytes;
+
+    uint64_t lexStart = statsNow();
+    int line = 1, col = 0;
+    char* bp = buf; // Buffer pointer
+    int status = lexLoop(&bp, &line, &col, NULL);
     struct Token eofToken = { .type = END_OF_FILE, .line = line, .col = col, .val = 0, .lexeme = NULL, .length = 0 };
-    emitToken(&eofToken);
+    if (status == 0) emitToken(&eofToken);
+    if (status < 0 || outOfMemory) {
+        if (outOfMemory) fprintf(stderr, "Memory allocation failed\n");
+        free(buf);
+        free(tb.buf);
+        freeLiterals(&tb.literals);
+        tb.buf = NULL; tb.src = NULL;
+        return tb;
+    }
+    statsEnd(PHASE_LEX, lexStart);
+    threadStats.tokens += tb.count;
+
+    return tb;
+}
 
+/* Incremental relexing:
+ * Applies an edit (remove `removed` bytes at `offset`, insert `inserted`) to old's source and relexes only the affected range.
+ * Lexing restarts at the first token of the edited line (a clean cut, see isCleanCut) and stops as soon as it reaches a clean boundary of the old
+ * token stream past the edit, the rest of the old tokens are moved up or down with their lexemes, lines and cols shifted.
+ * Edits that open or close a comment or string just keep the lexer going until the streams line up again (or to EOF).
+ * The edit is made in place: old's source, tokens and literal pool become the returned buffer, so a keystroke touches the tokens
+ * after the edit once and allocates nothing big. old must not be used or freed afterwards, also when relexing fails (the result
+ * then has NULL buf and src like a failed lexFile(), old's buffers are freed). inserted must not point into old's source.
+*/
+struct TokenBuffer relexEdit(struct TokenBuffer* old, size_t offset, size_t removed, const char* inserted, size_t insertedLength) {
+    struct TokenBuffer failed = { .buf = NULL, .src = NULL, .count = 0, .capacity = 0 };
+    struct Token* tokens = old->buf;
+    size_t count = old->count, capacity = old->capacity;
+    char* buf = old->src;
+    struct LiteralPool literals = old->literals;
+    struct TokenBuffer consumed = { 0 };
+    *old = consumed;
+
+    if (!buf) return failed; // Failed lex, or consumed by an earlier relexEdit()
+    size_t oldLength = strlen(buf);
+    if (offset > oldLength || removed > oldLength - offset || count == 0) {
+        free(tokens); free(buf); freeLiterals(&literals);
+        return failed;
+    }
+
+    // Lexing restarts at the last clean cut before the edit, or the start of the file: binary search for the first token at or
+    // after the edit (EOF, the last token, always is), then walk back. Tokens before the cut stay where they are.
+    uintptr_t oldBase = (uintptr_t)buf;
+    size_t low = 0, high = count - 1;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (tokenKey(&tokens[mid], oldBase, oldLength) < offset) low = mid + 1;
+        else high = mid;
+    }
+    size_t restart = low ? low - 1 : 0;
+    while (restart > 0 && !isCleanCut(tokens, restart, oldBase, oldLength)) restart--;
+    size_t restartPos = restart ? tokenStart(&tokens[restart], oldBase, oldLength) : 0;
+    int line = restartPos ? tokens[restart].line : 1; // Token 0 can be a cut too, after a leading comment
+    int col = restartPos ? tokens[restart].col : 0;
+
+    // Edit the source in place, it only moves if it has to grow
+    size_t newLength = oldLength - removed + insertedLength;
+    if (newLength > oldLength) {
+        char* grown = realloc(buf, newLength + 1);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed\n");
+            free(tokens); free(buf); freeLiterals(&literals);
+            return failed;
+        }
+        statsAlloc(PHASE_LEX, newLength + 1);
+        buf = grown;
+    }
+    memmove(buf + offset + insertedLength, buf + offset + removed, oldLength - offset - removed + 1); // With the '\0'
+    memcpy(buf + offset, inserted, insertedLength);
+
+    // The relexed range goes to a small buffer of its own, the old tokens after restart are still needed for resync.
+    // New string literals intern into the old pool.
+    if (initTokens(64)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(tokens); free(buf); freeLiterals(&literals);
+        return failed;
+    }
+    tb.src = buf;
+    tb.literals = literals;
+    struct Resync rs = { .oldTokens = tokens, .oldCount = count, .oldBase = oldBase, .oldLength = oldLength, .newSrc = buf,
+                         .editEnd = offset + insertedLength, .delta = (long)insertedLength - (long)removed, .next = restart, .openCall = NO_CALL };
+    char* bp = buf + restartPos;
+    int status = lexLoop(&bp, &line, &col, &rs);
+    if (status == 0) {
+        struct Token eofToken = { .type = END_OF_FILE, .line = line, .col = col, .val = 0, .lexeme = NULL, .length = 0 };
+        emitToken(&eofToken);
+    }
+    struct Token* relexed = tb.buf;
+    size_t relexedCount = tb.count, resume = status == 1 ? rs.next : count;
+    int dropped = status >= 0 && droppedLiteral(tokens + restart, resume - restart, relexed, relexedCount);
+
+    // Splice: move the old tokens after the resync point to their new index, shifting them as they go, then put the relexed
+    // range in front of them
+    size_t carried = status == 1 ? count - resume : 0;
+    size_t newCount = restart + relexedCount + carried;
+    if (status >= 0 && !outOfMemory && newCount > capacity) {
+        while (capacity < newCount) capacity *= 2;
+        struct Token* grown = realloc(tokens, capacity * sizeof(struct Token));
+        if (grown) {
+            tokens = grown;
+            statsAlloc(PHASE_LEX, capacity * sizeof(struct Token));
+        }
+        else outOfMemory = 1;
+    }
+    if (status < 0 || outOfMemory) {
+        if (outOfMemory) fprintf(stderr, "Memory allocation failed\n");
+        free(relexed); free(tokens); free(buf); freeLiterals(&tb.literals);
+        return failed;
+    }
+    if (carried) {
+        memmove(tokens + restart + relexedCount, tokens + resume, carried * sizeof(struct Token));
+        struct Token* token = tokens + restart + relexedCount;
+        int resumeLine = token->line, lineDelta = line - token->line, colDelta = col - token->col;
+        for (size_t i = 0; i < carried; i++, token++) {
+            if (token->lexeme) token->lexeme = buf + ((uintptr_t)token->lexeme - oldBase) + rs.delta;
+            if (token->line == resumeLine) token->col += colDelta;
+            token->line += lineDelta;
+        }
+    }
+    memcpy(tokens + restart, relexed, relexedCount * sizeof(struct Token));
+    free(relexed);
+    if ((uintptr_t)buf != oldBase) { // The source moved, so did the tokens before the edit
+        for (size_t i = 0; i < restart; i++) tokens[i].lexeme = buf + ((uintptr_t)tokens[i].lexeme - oldBase);
+    }
+    tb.buf = tokens;
+    tb.count = newCount;
+    tb.capacity = capacity;
+
+    // Strings the edit removed would stay in the pool, drop them (only needed when the relexed range lost a literal)
+    if (dropped && compactLiterals()) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(tokens); free(buf); freeLiterals(&tb.literals);
+        return failed;
+    }
     return tb;
-}
\ No newline at end of file
+}
@@ -1,6 +1,6 @@
 /* Ownership Rules:
- * Lexer allocates source buffer and the token array
- * Parser consumes both and frees them when done.
+ * Lexer allocates source buffer, the token array and the string literal pool
+ * Parser consumes them and frees them when done (freeLiterals() for the pool).
  * Individual token .lexeme pointers point into the source buffer.
 */
 
@@ -32,6 +32,23 @@
  * Induction Variable Elimination:
  * Loop Unrolling: Execute loop body multiple times per iteration, reducing overhead. Space tradeoff, program size increases.
  * ex: for (i=0;i<n;i++) { S } unrolled 4 times: for (i=0;i<n-3;i+=4) { S; S; S; S; } for (;i<n;i++) { S; }
+ * Scalar Replacement (register promotion): If an array element is read and written every iteration but its index does not depend on the loop variable,
+ * load it into a scalar temp before the loop, use the temp inside, and store it back after the loop (and before any break/return).
+ * ex: for (j=0;j<n;j++) { c[i] += a[i][j] * b[j]; } can be optimized to: t = c[i]; for (j=0;j<n;j++) { t += a[i][j] * b[j]; } c[i] = t;
+ * Only legal if every other access to c in the loop is provably a different element than c[i]: same index expression plus a nonzero constant
+ * (c[i+1]), or a constant index when i is also a known constant that differs. c[3] is not enough on its own, it is c[i] when i == 3.
+ * c must not be passed to a call, and no other array parameter may alias c (both parameters). Otherwise leave it to Loop Versioning below.
+ * A sliding window (a[j], a[j+1] read each iteration) is the same idea with a rotating set of temps: t0 = t1; t1 = a[j+1];
+ * Run after LICM (index expression must already be invariant) and before unrolling.
+ * Loop Unswitching: LICM for control flow. If a loop has an if whose condition is invariant, make one copy of the loop per outcome and test once outside.
+ * ex: for (i=0;i<n;i++) { if (flag) { a[i] = 0; } else { a[i] = i; } } -> if (flag) { for (...) { a[i] = 0; } } else { for (...) { a[i] = i; } }
+ * Each condition unswitched doubles the loop, so stop at a code size budget (total statements copied), pick the conditions in the hottest loops first.
+ * Run right after LICM (which makes the condition invariant), so strength reduction and unrolling see branch-free bodies.
+ * Loop Peeling: pull the first (or last) iterations out of the loop when they are special, the rest of the loop gets simpler.
+ * ex: for (i=0;i<n;i++) { if (i == 0) { x = 1; } else { x = a[i-1]; } ... } -> peel i = 0, the if folds away in both copies.
+ * Loop Versioning: when two array parameters might overlap, emit a runtime check and two loops: the optimized one (LICM, scalar replacement assume no
+ * overlap) and the original. ex: if (dst + n <= src || src + n <= dst) { fast loop } else { original loop }
+ * Cost: only worth it if the trip count is large enough to pay for the extra code and check, skip when the constant trip count is small.
 */
 
 /* Function Inlining:
@@ -40,19 +57,96 @@
  * Reduces function call overhead, enables further optimizations (constant folding, dead code elimination)
 */
 
+/* Compile-Time Evaluation of Pure Calls:
+ * S-C functions are non-recursive, so a call to a pure function with all constant arguments always terminates and can be run at compile time,
+ * even when the callee is too big to inline. ex: int t = crc_table(5); becomes int t = 1108378657;
+ * Purity: a function is pure if it only reads its parameters and locals (no globals, no array parameters written), and only calls pure functions.
+ * Walk the call graph bottom up (callees first, it is a DAG), so each function is marked once.
+ * Evaluate with the interpreter under a step limit (and consumeFuel(PHASE_FOLD)), if the limit is hit leave the call alone and emit a missed remark.
+ * Runs as part of constant folding, after inlining so calls exposed by inlining get folded too.
+ * If recursion is allowed (see Tail Calls) the call graph is no longer a DAG: functions in a recursive SCC are only evaluated under the step limit.
+*/
+
+/* Tail Calls (planned, lifts the non-recursive restriction for self recursion):
+ * A self call in tail position (return f(...);) becomes: assign the new argument values to the parameters (through temps, they may read each other) and
+ * jump back to the top of the body, so the function turns into a loop with a bounded stack frame, and the loop optimizations apply to it.
+ * ex: int sum(int n, int acc) { if (n == 0) return acc; return sum(n - 1, acc + n); } -> while (n != 0) { acc = acc + n; n = n - 1; } return acc;
+ * Other tail calls (return g(...);) get marked so a backend can emit a jump instead of call + ret.
+ * Inlining: functions in a recursive SCC of the call graph are never inlined into each other (or only a bounded number of levels deep).
+*/
+
+/* Constant Arrays:
+ * An array whose every element is known at compile time becomes a static data table instead of code that fills it at startup.
+ * Sources: a literal initializer (int t[4] = {1, 2, 3, 4};) or a fill loop with a constant trip count and a body that only depends on i
+ * ex: for (i=0;i<256;i++) { t[i] = i*i; } is removed and t is emitted as a 256 entry table.
+ * The loop is evaluated (fold the body for i = 0..n-1), given up on if the trip count is over a size limit or if t is written anywhere else.
+ * After that, reads with constant indices fold to literals: t[5] becomes 25. Runs with constant folding, before dead code elimination removes the loop.
+*/
+
+/* Jump Threading:
+ * If a block's branch outcome is already decided on some incoming edge, send that edge straight to the right successor.
+ * ex: if (mode == 2) { A } if (mode == 2) { B } -> when A ran, the second test is true, so that path goes straight to B.
+ * ex: done = false; ... if (done) { X } -> the edge from the assignment skips the test (and X).
+ * Needs a CFG: for each block ending in a branch, look at each predecessor for a constant assignment to the tested variable or an earlier test
+ * of the same condition with nothing in between that writes it. The block between the edge and the branch is duplicated for that edge only,
+ * so cap it with a size limit (statements copied per thread) and consumeFuel(PHASE_FOLD). Run before constant folding so folding cleans up the copies.
+*/
+
+/* If-Conversion:
+ * A small if/else where both arms only assign the same variable from cheap, side-effect free expressions becomes a select, no branch left to mispredict.
+ * ex: if (a < b) { x = a; } else { x = b; } -> x = a < b ? a : b;   if (c) { x = x + 1; } -> x = x + (c != 0);
+ * Cheap: no calls, no division (could trap when the arm wasn't going to run), no array writes, a few operators per arm.
+ * Output: cmov in the asm backend, ?: in the C emitter (or the mask form x = b ^ ((a ^ b) & -(a < b)) for ints).
+ * Run after LICM and before unrolling, a loop body with no branches left is easier to unroll (and vectorize).
+*/
+
 /* Optimization Order:
  * 1. Function Inlining
  * 2. Constant Folding
  * 3. Dead Code Elimination
  * 4. Loop Invariant Code Motion
+ *    (Scalar Replacement)
  * 5. Loop Strength Reduction
  * 6. Induction Variable Elimination
  * 7. Loop Unrolling
 */
 
+/* Compilation Cache:
+ * cacheKey() below: sourceHash() (FNV-1a of SC_VERSION + the source bytes) chained with -O, the enabled passes and the budgets, so any change
+ * to the source, the optimizer or its flags gives a new key. Runs with -fuel are for bisecting and should not be cached.
+ * Deferred until there is optimized output to store. The only thing to cache today is the token image, and a hit doesn't pay: on a 5 MB file
+ * loading and verifying its 42 MB image takes 70 ms against 89 ms for lexFile() (-O2), 161 vs 154 ms at -O0, before hashing the source for
+ * the key, and a miss adds a 139 ms image write.
+ * Plan: write the optimized output to <cacheDir>/<hash in hex> and check for that file right after lexFile() reads the source.
+ * Writes go to a temp file in the same directory and are rename()d into place so concurrent compiles never see a partial entry.
+ * Eviction: when the directory grows past a size limit, delete entries with the oldest access time first.
+ * Per-function (incremental) version: fingerprint = hashBytes() over each token's type + lexeme from the function name to its closing }, (not line/col, so
+ * moving a function doesn't invalidate it) chained with the fingerprints of every callee that was inlined into it.
+ * Cache optimized functions by fingerprint, on a rebuild only functions whose fingerprint changed (and the functions that inlined them) are re-optimized.
+*/
+
+/* Differential Fuzzing (planned):
+ * Needs an interpreter (or emitted code) first, the optimizer's output has to be run to be checked.
+ * Generator: random S-C programs that always terminate and have no UB. for loops only with constant bounds and the induction variable never written
+ * in the body, array indices always i % size, no division by anything but non-zero literals, shifts only by 0..31, calls only to functions defined
+ * earlier in the file (so the call graph is acyclic). Every variable is printed at the end so dead code elimination can't hide a wrong value.
+ * Harness: run each program at -O0 and -O1..-O3 (and with each -fno-<pass>) and compare outputs, any difference is a miscompile.
+ * Reduction: delta debugging over the token stream (drop halves, then quarters, ... of the tokens, keep any smaller program that still lexes, parses
+ * and still gives different outputs), then write the smallest one out as a reproducer. Run with the -fno- flags to name the pass responsible.
+*/
+
+/* Compile Server:
+ * sc_server.c, --serve <socket> runs compileCommand() for each command line a --connect client sends, in one of its worker processes,
+ * with the client's cwd and stdio.
+ * The compilation cache above is what would be kept warm between requests once there is optimized output to cache.
+*/
+
 #include "sc_token.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
 void parseBlock(struct Parser* ps);
 
 // ChatGPT functions to print tokens (for testing)
@@ -82,6 +176,7 @@ void print_token(const struct Token* t) {
     printf("  val: %f\n", t->val);
     printf("  line: %d, col: %d\n", t->line, t->col);
     printf("  length: %d\n", t->length);
+    if (t->type == STR_LITERAL) printf("  literal: %d\n", t->literalId);
     printf("}\n");
 }
 
@@ -207,19 +302,232 @@ void parseProgram(struct Parser* ps) {
     }
 }
 
-// Main parser function
-int main() {
-    char fileName[1024];
-    printf("Entire path to input file: \n");
-    scanf("%1024s", fileName); // Take file path
+// Command line options
+struct Options {
+    char** inputs; // Input file paths
+    int inputCount;
+    int inputCapacity;
+    const char* output; // -o, token image path (single input only)
+    int optLevel; // -O0..-O3
+    int passEnabled[PASS_COUNT]; // Set from optLevel, then overridden by -f flags
+    int passForced[PASS_COUNT]; // 1 = forced on, -1 = forced off, 0 = use optLevel
+    int jobs; // -j N, files compiled concurrently
+    int dumpTokens; // --dump-tokens
+    int timeReport; // -ftime-report (1) or --stats-json (2)
+    const char* tracePath; // --trace, Chrome trace-event JSON output
+    const char* remarksPath; // --remarks, optimization remarks output
+    const char* remarksFilter; // -Rpass=<regex>, passes to report (default all)
+    int remarksJson; // --remarks-format=json
+    char** responseTexts; // Contents of @files, option values point into them
+    int responseCount;
+    int responseDepth; // @files being read right now (nested)
+};
+
+#define PREFETCH_AHEAD 8 // Inputs past the one being compiled whose reads are started early
 
-    struct TokenBuffer tb = lexFile(fileName); // Call lexer and tokenize file
+// Shared state for batch compilation workers
+struct Batch {
+    struct Options* opts;
+    int next; // Next input index to compile
+    int prefetched; // Inputs before this index have had prefetchFile() called
+    int errCount; // Total errors across all inputs
+    pthread_mutex_t lock;
+};
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <file.sc>... [@responsefile]\n", prog);
+    fprintf(stderr, "  -o <file>        Write the token image for the (single) input to <file>\n");
+    fprintf(stderr, "  -O0 -O1 -O2 -O3  Optimization level (default -O1)\n");
+    fprintf(stderr, "  -f<pass>         Enable a pass, -fno-<pass> disables it\n");
+    fprintf(stderr, "                   passes: inline fold dce licm strength-reduce ive unroll\n");
+    fprintf(stderr, "  -j <N>           Compile up to N files concurrently\n");
+    fprintf(stderr, "  -fuel=<N>        Allow at most N transforms in total, -fuel=<pass>=<N> for one pass\n");
+    fprintf(stderr, "  -fbudget-ms=<N>  Stop optimizing a function after N ms\n");
+    fprintf(stderr, "  -fbudget-growth=<P>  Stop optimizing a function once it grows past P%% of its starting size\n");
+    fprintf(stderr, "  --dump-tokens    Print every token\n");
+    fprintf(stderr, "  -ftime-report    Print time and allocations per phase to stderr\n");
+    fprintf(stderr, "  --stats-json     Same as -ftime-report, as JSON\n");
+    fprintf(stderr, "  --trace <file>   Write a Chrome trace-event JSON of every phase, one track per thread\n");
+    fprintf(stderr, "  --remarks <file> Write optimization remarks to <file> (- for stdout)\n");
+    fprintf(stderr, "  -Rpass=<regex>   Only report remarks from passes matching <regex>\n");
+    fprintf(stderr, "  --remarks-format=yaml|json\n");
+    fprintf(stderr, "An input of - reads the source from stdin (or a pipe).\n");
+    fprintf(stderr, "With no arguments the input path is read from stdin.\n");
+    fprintf(stderr, "Compile server: %s --serve <socket> [-j <workers>], then %s --connect <socket> [options] <file.sc>...\n", prog, prog);
+}
+
+int addInput(struct Options* opts, const char* path) {
+    if (opts->inputCount == opts->inputCapacity) {
+        opts->inputCapacity = opts->inputCapacity ? opts->inputCapacity * 2 : 16;
+        char** temp = realloc(opts->inputs, opts->inputCapacity * sizeof(char*));
+        if (!temp) {
+            fprintf(stderr, "Memory reallocation failed!\n");
+            return -1;
+        }
+        opts->inputs = temp;
+    }
+    opts->inputs[opts->inputCount] = strdup(path);
+    if (!opts->inputs[opts->inputCount]) return -1;
+    opts->inputCount++;
+    return 0;
+}
+
+int parseArgs(struct Options* opts, int argc, char** argv);
+
+#define MAX_RESPONSE_DEPTH 16 // @file inside @file, plenty for real use and stops a file that includes itself
+
+// @file: whitespace separated arguments, read as if they were on the command line (so "-j 4" and "-o out" work across words). Returns what parseArgs() returns
+int readResponseFile(struct Options* opts, const char* fileName) {
+    if (opts->responseDepth >= MAX_RESPONSE_DEPTH) {
+        fprintf(stderr, "Response files nested more than %d deep at %s (does it include itself?)\n", MAX_RESPONSE_DEPTH, fileName);
+        return -1;
+    }
+    FILE* file = fopen(fileName, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening response file %s\n", fileName);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char* text = size >= 0 ? malloc(size + 1) : NULL;
+    char** temp = realloc(opts->responseTexts, (opts->responseCount + 1) * sizeof(char*));
+    if (!text || !temp) {
+        fprintf(stderr, "Memory allocation failed\n");
+        fclose(file);
+        free(text);
+        return -1;
+    }
+    opts->responseTexts = temp;
+    opts->responseTexts[opts->responseCount++] = text; // Kept until exit, -o, --trace and -Rpass= values point into it
+    text[fread(text, 1, size, file)] = '\0';
+    fclose(file);
+
+    int argc = 1, capacity = 16;
+    char** args = malloc(capacity * sizeof(char*));
+    if (!args) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    args[0] = "sc_opt"; // parseArgs skips argv[0]
+    for (char* word = strtok(text, " \t\r\n"); word; word = strtok(NULL, " \t\r\n")) {
+        if (argc == capacity) {
+            char** grown = realloc(args, capacity * 2 * sizeof(char*));
+            if (!grown) {
+                fprintf(stderr, "Memory reallocation failed!\n");
+                free(args);
+                return -1;
+            }
+            args = grown;
+            capacity *= 2;
+        }
+        args[argc++] = word;
+    }
+    opts->responseDepth++;
+    int status = parseArgs(opts, argc, args);
+    opts->responseDepth--;
+    free(args);
+    return status;
+}
+
+static int setJobs(struct Options* opts, const char* text) {
+    long jobs;
+    if (parseCount(text, INT_MAX, &jobs) || jobs < 1) {
+        fprintf(stderr, "Invalid job count: %s\n", text);
+        return -1;
+    }
+    opts->jobs = (int)jobs;
+    return 0;
+}
+
+// Returns 0 when the command line is good, -1 on an error (already reported), 1 for -h
+int parseArgs(struct Options* opts, int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        if (arg[0] == '@') {
+            int status = readResponseFile(opts, arg + 1);
+            if (status) return status;
+        }
+        else if (!strcmp(arg, "-o") || !strcmp(arg, "-j") || !strcmp(arg, "--trace") || !strcmp(arg, "--remarks")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value after %s\n", arg);
+                return -1;
+            }
+            if (arg[1] == 'o') opts->output = argv[++i];
+            else if (arg[1] == 'j') { if (setJobs(opts, argv[++i])) return -1; }
+            else if (!strcmp(arg, "--trace")) opts->tracePath = argv[++i];
+            else opts->remarksPath = argv[++i];
+        }
+        else if (!strncmp(arg, "-Rpass=", 7)) { opts->remarksFilter = arg + 7; }
+        else if (!strcmp(arg, "--remarks-format=yaml") || !strcmp(arg, "--remarks-format=json")) { opts->remarksJson = arg[17] == 'j'; }
+        else if (!strncmp(arg, "-j", 2)) { if (setJobs(opts, arg + 2)) return -1; }
+        else if (!strncmp(arg, "-O", 2) && arg[2] >= '0' && arg[2] <= '3' && !arg[3]) { opts->optLevel = arg[2] - '0'; }
+        else if (!strncmp(arg, "-fuel=", 6)) {
+            if (setFuel(arg + 6)) {
+                fprintf(stderr, "Invalid fuel: %s\n", arg + 6);
+                return -1;
+            }
+        }
+        else if (!strncmp(arg, "-fbudget-ms=", 12)) {
+            if (parseCount(arg + 12, LONG_MAX, &budgetMillis)) {
+                fprintf(stderr, "Invalid time budget: %s\n", arg + 12);
+                return -1;
+            }
+        }
+        else if (!strncmp(arg, "-fbudget-growth=", 16)) {
+            long growth;
+            if (parseCount(arg + 16, INT_MAX, &growth)) {
+                fprintf(stderr, "Invalid growth budget: %s\n", arg + 16);
+                return -1;
+            }
+            budgetGrowth = (int)growth;
+        }
+        else if (!strcmp(arg, "-ftime-report")) { opts->timeReport = 1; }
+        else if (!strcmp(arg, "--stats-json")) { opts->timeReport = 2; }
+        else if (!strncmp(arg, "-f", 2)) {
+            int enable = strncmp(arg, "-fno-", 5) != 0;
+            const char* name = enable ? arg + 2 : arg + 5;
+            int found = 0;
+            for (int p = 0; p < PASS_COUNT; p++) {
+                if (!strcmp(name, phaseNames[PHASE_INLINE + p])) { opts->passForced[p] = enable ? 1 : -1; found = 1; }
+            }
+            if (!found) {
+                fprintf(stderr, "Unknown pass: %s\n", name);
+                return -1;
+            }
+        }
+        else if (!strcmp(arg, "--dump-tokens")) { opts->dumpTokens = 1; }
+        else if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) { return 1; } // The caller prints usage and exits 0, a --serve request must not end the server
+        else if (arg[0] == '-' && arg[1]) {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return -1;
+        }
+        else if (addInput(opts, arg)) return -1;
+    }
+    return 0;
+}
+
+// Key for anything stored from this compile, see Compilation Cache above
+static unsigned long long cacheKey(const struct TokenBuffer* tb, const struct Options* opts) {
+    unsigned long long key = sourceHash(tb);
+    key = hashBytes((const char*)&opts->optLevel, sizeof(opts->optLevel), key);
+    key = hashBytes((const char*)opts->passEnabled, sizeof(opts->passEnabled), key);
+    key = hashBytes((const char*)&budgetMillis, sizeof(budgetMillis), key);
+    return hashBytes((const char*)&budgetGrowth, sizeof(budgetGrowth), key);
+}
+
+// Lex (and eventually parse + optimize) one file, returns its error count
+int compileFile(const char* fileName, struct Options* opts, pthread_mutex_t* outputLock) {
+    uint64_t compileStart = statsNow();
+    statsSetFile(fileName);
+    struct TokenBuffer tb = lexFile((char*)fileName); // Call lexer and tokenize file
     struct Parser ps;
 
     if (tb.buf == NULL || tb.src == NULL) { // Ensure no memory errors
-        printf("Memory error detected, Exiting...");
+        fprintf(stderr, "%s: could not be lexed\n", fileName);
         if (tb.src) free(tb.src); // src allocates before buf, so if src succeeds but buf fails, we must free src.
-        return -1;
+        statsFlush();
+        return 1;
     }
 
     ps.errCount = 0; ps.pos = 0;
@@ -227,12 +535,142 @@ int main() {
     ps.tokens = tb.buf;
     ps.count = tb.count;
 
-    while (ps.pos < ps.count) {
-        print_token(&ps.tokens[ps.pos]);
-        ps.pos++;
+    if (opts->dumpTokens) {
+        pthread_mutex_lock(outputLock); // Keep each file's dump together under -j
+        while (ps.pos < ps.count) {
+            print_token(&ps.tokens[ps.pos]);
+            ps.pos++;
+        }
+        pthread_mutex_unlock(outputLock);
+        ps.pos = 0;
     }
     //parseProgram(&ps);
 
+    if (opts->output) {
+        uint64_t imageStart = statsNow();
+        if (writeTokenImage(opts->output, &tb, cacheKey(&tb, opts))) {
+            fprintf(stderr, "%s: could not write %s\n", fileName, opts->output);
+            ps.errCount++;
+        }
+        statsEnd(PHASE_IMAGE, imageStart);
+    }
+    threadStats.files++;
+    statsFlush();
+    if (traceEnabled) traceSpan("compile", compileStart, statsNow());
+
     free(tb.buf); // Free tokenbuffer buf and regular buf allocated in lexer (stored in .src and .buf)
     free(tb.src);
-}
\ No newline at end of file
+    freeLiterals(&tb.literals);
+    return ps.errCount;
+}
+
+void* compileWorker(void* arg) {
+    struct Batch* batch = arg;
+    while (1) {
+        pthread_mutex_lock(&batch->lock);
+        int index = batch->next++;
+        int prefetchFrom = batch->prefetched > index + 1 ? batch->prefetched : index + 1;
+        int prefetchTo = index + 1 + PREFETCH_AHEAD < batch->opts->inputCount ? index + 1 + PREFETCH_AHEAD : batch->opts->inputCount;
+        if (prefetchTo > batch->prefetched) batch->prefetched = prefetchTo;
+        pthread_mutex_unlock(&batch->lock);
+        if (index >= batch->opts->inputCount) break;
+
+        for (int i = prefetchFrom; i < prefetchTo; i++) prefetchFile(batch->opts->inputs[i]); // Reads of the next inputs overlap with this one
+
+        int errors = compileFile(batch->opts->inputs[index], batch->opts, &batch->lock);
+        pthread_mutex_lock(&batch->lock);
+        batch->errCount += errors;
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+static void freeOptions(struct Options* opts) {
+    for (int i = 0; i < opts->inputCount; i++) free(opts->inputs[i]);
+    free(opts->inputs);
+    for (int i = 0; i < opts->responseCount; i++) free(opts->responseTexts[i]);
+    free(opts->responseTexts);
+}
+
+// Compile every input in opts on -j workers, returns the exit code. Frees opts' inputs and @file texts
+static int runBatch(struct Options* opts) {
+    if (opts->inputCount == 0) {
+        fprintf(stderr, "No input files\n");
+        freeOptions(opts);
+        return 2;
+    }
+    if (opts->output && opts->inputCount > 1) {
+        fprintf(stderr, "-o can only be used with a single input file\n");
+        freeOptions(opts);
+        return 2;
+    }
+    for (int p = 0; p < PASS_COUNT; p++) { // -O1 and up run every pass, unrolling only from -O2
+        opts->passEnabled[p] = opts->optLevel >= (p == PASS_COUNT - 1 ? 2 : 1);
+        if (opts->passForced[p]) opts->passEnabled[p] = opts->passForced[p] > 0;
+    }
+
+    statsEnabled = opts->timeReport != 0;
+    if (opts->tracePath) traceBegin();
+    if ((opts->remarksPath || opts->remarksFilter) && remarksBegin(opts->remarksPath ? opts->remarksPath : "-", opts->remarksFilter ? opts->remarksFilter : ".*", opts->remarksJson)) {
+        freeOptions(opts);
+        return 2;
+    }
+
+    struct Batch batch = { .opts = opts, .next = 0, .prefetched = 0, .errCount = 0 };
+    pthread_mutex_init(&batch.lock, NULL);
+
+    int jobs = opts->jobs < 1 ? 1 : (opts->jobs > opts->inputCount ? opts->inputCount : opts->jobs);
+    pthread_t* workers = malloc(jobs * sizeof(pthread_t));
+    if (!workers) {
+        fprintf(stderr, "Memory allocation failed\n");
+        remarksEnd();
+        freeOptions(opts);
+        return 1;
+    }
+    int started = 0;
+    for (int i = 1; i < jobs; i++) { // Calling thread is worker 0
+        if (pthread_create(&workers[i], NULL, compileWorker, &batch) == 0) started = i;
+        else break;
+    }
+    compileWorker(&batch);
+    for (int i = 1; i <= started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_mutex_destroy(&batch.lock);
+    if (opts->timeReport) statsReport(stderr, opts->timeReport == 2);
+    if (opts->tracePath && traceWrite(opts->tracePath)) batch.errCount++;
+    if (remarksEnd()) batch.errCount++;
+
+    freeOptions(opts);
+    return batch.errCount > 0 ? 1 : 0;
+}
+
+// One sc_opt command line, from a fresh start: used by main() and for each --serve request
+int compileCommand(int argc, char** argv) {
+    struct Options opts = { .optLevel = 1, .jobs = 1 };
+    initFuel();
+    statsReset();
+    int status = parseArgs(&opts, argc, argv);
+    if (status) {
+        usage(argv[0]);
+        freeOptions(&opts);
+        return status > 0 ? 0 : 2;
+    }
+    return runBatch(&opts);
+}
+
+// Main parser function
+int main(int argc, char** argv) {
+    if (argc >= 3 && !strcmp(argv[1], "--serve")) return serveRequests(argv[2], argc - 3, argv + 3);
+    if (argc >= 3 && !strcmp(argv[1], "--connect")) return sendRequest(argv[2], argc - 3, argv + 3);
+
+    if (argc < 2) { // Interactive fallback
+        struct Options opts = { .optLevel = 1, .jobs = 1, .dumpTokens = 1 };
+        initFuel();
+        char fileName[1025];
+        printf("Entire path to input file: \n");
+        if (scanf("%1024s", fileName) != 1) return 1; // Take file path
+        if (addInput(&opts, fileName)) return 1;
+        return runBatch(&opts);
+    }
+    return compileCommand(argc, argv);
+}
@@ -0,0 +1,80 @@
+/* Optimization Remarks:
+ * Passes report what they did (applied), what they considered and rejected (missed, with the reason and the cost vs threshold)
+ * and what they worked out (analysis), tied to a token so the remark points at the source line.
+ * Use REMARK() from sc_token.h, not emitRemark() directly, so a disabled pass costs one mask check and no argument setup.
+ * Remarks are filtered per pass with a POSIX extended regex over the pass names, and written as YAML documents (same shape
+ * as LLVM's -fsave-optimization-record) or as JSON, one object per line.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#include <pthread.h>
+#include "sc_token.h"
+
+unsigned remarkMask = 0;
+static FILE* remarkOut;
+static int remarkJson;
+static pthread_mutex_t remarkLock = PTHREAD_MUTEX_INITIALIZER;
+static const char* kindNames[] = { "Passed", "Missed", "Analysis" };
+
+// Enable remarks for every pass whose name matches passRegex, written to fileName ("-" for stdout)
+int remarksBegin(const char* fileName, const char* passRegex, int json) {
+    regex_t regex;
+    if (regcomp(&regex, passRegex, REG_EXTENDED | REG_NOSUB)) {
+        fprintf(stderr, "Invalid remark pass regex: %s\n", passRegex);
+        return -1;
+    }
+    unsigned mask = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (regexec(&regex, phaseNames[p], 0, NULL, 0) == 0) mask |= 1u << p;
+    }
+    regfree(&regex);
+
+    remarkOut = strcmp(fileName, "-") ? fopen(fileName, "w") : stdout;
+    if (!remarkOut) {
+        fprintf(stderr, "Error opening remarks file %s\n", fileName);
+        return -1;
+    }
+    remarkJson = json;
+    remarkMask = mask;
+    return 0;
+}
+
+// cost/threshold < 0 are left out (remarks that aren't cost based)
+void emitRemark(enum Phase pass, enum RemarkKind kind, const char* function, const struct Token* token, const char* reason, int cost, int threshold) {
+    const char* file = currentFile ? currentFile : "";
+    int line = token ? token->line : 0, col = token ? token->col : 0;
+
+    pthread_mutex_lock(&remarkLock); // Remarks are rare enough that one lock keeps each record whole under -j
+    if (remarkJson) {
+        fprintf(remarkOut, "{\"kind\":\"%s\",\"pass\":\"%s\",\"file\":", kindNames[kind], phaseNames[pass]);
+        writeJsonString(remarkOut, file);
+        fprintf(remarkOut, ",\"function\":");
+        writeJsonString(remarkOut, function ? function : "");
+        fprintf(remarkOut, ",\"line\":%d,\"col\":%d,\"reason\":", line, col);
+        writeJsonString(remarkOut, reason);
+        if (cost >= 0) fprintf(remarkOut, ",\"cost\":%d", cost);
+        if (threshold >= 0) fprintf(remarkOut, ",\"threshold\":%d", threshold);
+        fprintf(remarkOut, "}\n");
+    }
+    else {
+        fprintf(remarkOut, "--- !%s\nPass: %s\nFile: ", kindNames[kind], phaseNames[pass]);
+        writeJsonString(remarkOut, file);
+        fprintf(remarkOut, "\nFunction: ");
+        writeJsonString(remarkOut, function ? function : "");
+        fprintf(remarkOut, "\nDebugLoc: { Line: %d, Column: %d }\nReason: ", line, col);
+        writeJsonString(remarkOut, reason);
+        if (cost >= 0) fprintf(remarkOut, "\nCost: %d", cost);
+        if (threshold >= 0) fprintf(remarkOut, "\nThreshold: %d", threshold);
+        fprintf(remarkOut, "\n...\n");
+    }
+    pthread_mutex_unlock(&remarkLock);
+}
+
+int remarksEnd(void) {
+    remarkMask = 0;
+    if (!remarkOut || remarkOut == stdout) return 0;
+    int status = fclose(remarkOut);
+    remarkOut = NULL;
+    return status == 0 ? 0 : -1;
+}
@@ -0,0 +1,412 @@
+/* Compile Server:
+ * sc_opt --serve <socket> stays running and listens on a Unix domain socket, sc_opt --connect <socket> [options] <file.sc>...
+ * is a thin client that hands its command line to it, so a build system pays for process startup (and a cold page cache) once.
+ * Request: header (magic, argument count, payload length) then the client's cwd and arguments, each '\0' terminated.
+ * The client's stdin, stdout and stderr go along as SCM_RIGHTS fds, the server compiles with them as its own 0/1/2, so
+ * diagnostics, --dump-tokens and - (stdin) inputs behave exactly as in a local run. Response: the exit code as an int32.
+ * Concurrency: the server forks -j worker processes (default: one per CPU) that all accept() on the socket, each serves one
+ * request at a time. Fuel, stats, trace and remarks are process wide and reset for each command line, and the dup2() and chdir()
+ * above only touch the worker's own process, so every request in flight has its own state, stdio and cwd. A worker that dies
+ * is replaced. A request still compiles its inputs on -j compileWorker() threads, the same worker pool a local run uses.
+ * A worker acknowledges a connection as soon as it accepts it, and the client only sends its request then. A client that gets no
+ * acknowledgement within ACCEPT_WAIT_MS (every worker busy) closes the connection and compiles in its own process, so a parallel
+ * build never queues behind the server. Workers give up on a client that doesn't send its request within REQUEST_TIMEOUT_SECONDS.
+ * The socket is created 0600, a client hands over its fds and the server runs with its owner's rights.
+ * If nothing is listening on the socket, --connect compiles in its own process, so a build never depends on the server.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "sc_token.h"
+
+#define REQUEST_MAGIC 0x53435251 // "SCRQ"
+#define MAX_REQUEST_BYTES (1 << 20) // cwd + arguments, more than any real command line
+#define REQUEST_FDS 3 // stdin, stdout, stderr
+#define ACCEPT_WAIT_MS 50 // How long a client waits for a free worker before it compiles by itself
+#define REQUEST_TIMEOUT_SECONDS 10 // For the request to arrive once a worker has accepted, compiling it has no limit
+#define ACCEPTED 'A' // Sent by a worker when it takes a connection
+
+struct RequestHeader {
+    uint32_t magic;
+    uint32_t argCount; // Arguments after the cwd
+    uint32_t length; // Payload bytes: cwd and arguments, each '\0' terminated
+};
+
+static volatile sig_atomic_t stopRequested;
+static volatile sig_atomic_t isWorker, serving; // serving: a worker is between accept() and its answer
+
+// SIGINT / SIGTERM: an idle worker exits at once (it may be blocked in accept()), a busy one finishes its request first
+static void requestStop(int sig) {
+    (void)sig;
+    if (isWorker && !serving) _exit(0);
+    stopRequested = 1;
+}
+
+static int writeAll(int fd, const void* data, size_t length) {
+    const char* p = data;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n; length -= n;
+    }
+    return 0;
+}
+
+static int readAll(int fd, void* data, size_t length) {
+    char* p = data;
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n; length -= n;
+    }
+    return 0;
+}
+
+static int socketAddress(const char* socketPath, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return -1;
+    }
+    strcpy(addr->sun_path, socketPath);
+    return 0;
+}
+
+static int connectTo(const char* socketPath) {
+    struct sockaddr_un addr;
+    if (socketAddress(socketPath, &addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Runs one command line with the client's fds as 0/1/2 and its cwd, returns the exit code
+static int runRequest(const char* cwd, int argc, char** argv, const int* fds) {
+    int saved[REQUEST_FDS];
+    int savedCwd = open(".", O_RDONLY | O_DIRECTORY);
+    fflush(stdout); fflush(stderr);
+    for (int i = 0; i < REQUEST_FDS; i++) {
+        saved[i] = dup(i);
+        dup2(fds[i], i);
+    }
+
+    int status = 2;
+    if (savedCwd < 0 || chdir(cwd)) fprintf(stderr, "sc_opt server: can't change to %s\n", cwd);
+    else status = compileCommand(argc, argv);
+
+    fflush(stdout); fflush(stderr);
+    clearerr(stdin); // A - input reads the client's stdin to EOF
+    for (int i = 0; i < REQUEST_FDS; i++) {
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+    if (savedCwd >= 0) {
+        if (fchdir(savedCwd)) fprintf(stderr, "sc_opt server: can't change back to its own directory\n");
+        close(savedCwd);
+    }
+    return status;
+}
+
+// payload: cwd, then the arguments. argv[0] is ours, -1 if the payload holds fewer arguments than the header says
+static int splitArguments(char* payload, const struct RequestHeader* header, char** argv) {
+    char* p = payload + strlen(payload) + 1;
+    char* end = payload + header->length;
+    argv[0] = "sc_opt";
+    for (uint32_t i = 0; i < header->argCount; i++) {
+        if (p >= end) return -1;
+        argv[i + 1] = p;
+        p += strlen(p) + 1;
+    }
+    argv[header->argCount + 1] = NULL;
+    return 0;
+}
+
+static int answerRequest(int conn, const struct RequestHeader* header, const int* fds) {
+    char* payload = malloc(header->length);
+    char** argv = malloc((header->argCount + 2) * sizeof(char*));
+    int status = -1;
+    if (!payload || !argv) {
+        fprintf(stderr, "Memory allocation failed\n");
+    }
+    else if (readAll(conn, payload, header->length) || payload[header->length - 1] != '\0' || splitArguments(payload, header, argv)) {
+        fprintf(stderr, "sc_opt server: malformed request\n");
+    }
+    else {
+        int32_t exitCode = runRequest(payload, header->argCount + 1, argv, fds);
+        status = writeAll(conn, &exitCode, sizeof(exitCode)) ? -1 : 0; // The client may have gone, nothing to do about it
+    }
+    free(payload);
+    free(argv);
+    return status;
+}
+
+// Reads one request from a connection and answers it, -1 if the request was malformed
+static int handleConnection(int conn) {
+    struct RequestHeader header;
+    char control[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+    ssize_t n = recvmsg(conn, &msg, MSG_WAITALL);
+
+    int fds[REQUEST_FDS], fdCount = 0;
+    struct cmsghdr* cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (fdCount > REQUEST_FDS) fdCount = REQUEST_FDS; // The kernel truncates to our buffer, this is just belt and braces
+        memcpy(fds, CMSG_DATA(cmsg), fdCount * sizeof(int));
+    }
+
+    int status = -1;
+    if (n == 0) {
+        // Connected and closed, e.g. another --serve checking whether the socket is in use, or a client that stopped waiting
+    }
+    else if (n < 0) {
+        fprintf(stderr, "sc_opt server: reading a request failed: %s\n", strerror(errno)); // EAGAIN: REQUEST_TIMEOUT_SECONDS passed
+    }
+    else if (n != (ssize_t)sizeof(header) || header.magic != REQUEST_MAGIC || fdCount != REQUEST_FDS ||
+             header.length == 0 || header.length > MAX_REQUEST_BYTES || header.argCount >= header.length) {
+        fprintf(stderr, "sc_opt server: malformed request\n");
+    }
+    else {
+        status = answerRequest(conn, &header, fds);
+    }
+    for (int i = 0; i < fdCount; i++) close(fds[i]);
+    return status;
+}
+
+// Worker process: takes connections off the listening socket until the server stops
+static void serveConnections(int fd) {
+    struct timeval timeout = { .tv_sec = REQUEST_TIMEOUT_SECONDS };
+    isWorker = 1;
+    while (!stopRequested) {
+        int conn = accept(fd, NULL, NULL);
+        serving = 1;
+        if (conn < 0) {
+            serving = 0;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Error accepting a connection: %s\n", strerror(errno));
+            break;
+        }
+        char accepted = ACCEPTED;
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (writeAll(conn, &accepted, 1) == 0) handleConnection(conn); // A client that stopped waiting has closed, nothing to read
+        close(conn);
+        serving = 0;
+    }
+}
+
+// Forks a worker process serving fd, returns its pid or -1. workerMask: the signal mask the worker runs with
+static pid_t startWorker(int fd, const sigset_t* workerMask) {
+    fflush(stdout); fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, workerMask, NULL);
+        serveConnections(fd);
+        close(fd);
+        exit(0);
+    }
+    if (pid < 0) fprintf(stderr, "Error starting a server worker: %s\n", strerror(errno));
+    return pid;
+}
+
+// sc_opt --serve <socket> [-j <workers>]
+int serveRequests(const char* socketPath, int argc, char** argv) {
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc == 2 && !strcmp(argv[0], "-j")) {
+        if (parseCount(argv[1], 1024, &workers) || workers < 1) {
+            fprintf(stderr, "Invalid worker count: %s\n", argv[1]);
+            return 2;
+        }
+    }
+    else if (argc != 0) {
+        fprintf(stderr, "Usage: sc_opt --serve <socket> [-j <workers>]\n");
+        return 2;
+    }
+    if (workers < 1) workers = 1;
+
+    struct sockaddr_un addr;
+    if (socketAddress(socketPath, &addr)) return 2;
+    int running = connectTo(socketPath);
+    if (running >= 0) {
+        close(running);
+        fprintf(stderr, "A server is already listening on %s\n", socketPath);
+        return 2;
+    }
+    struct stat st;
+    if (lstat(socketPath, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s exists and is not a socket\n", socketPath);
+            return 2;
+        }
+        unlink(socketPath); // Left over from a server that didn't exit cleanly
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating socket: %s\n", strerror(errno));
+        return 2;
+    }
+    mode_t oldMask = umask(077); // Owner only, see the top of this file
+    int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(oldMask);
+    if (bound || listen(fd, 64)) {
+        fprintf(stderr, "Error listening on %s: %s\n", socketPath, strerror(errno));
+        close(fd);
+        return 2;
+    }
+    pid_t* pids = calloc(workers, sizeof(pid_t));
+    if (!pids) {
+        fprintf(stderr, "Memory allocation failed\n");
+        close(fd);
+        unlink(socketPath);
+        return 1;
+    }
+
+    struct sigaction stop = { .sa_handler = requestStop }; // For the workers. No SA_RESTART, a blocked accept() returns EINTR
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN); // A client that exits early must not take the server with it
+    sigset_t signals, workerMask; // The parent takes its signals with sigwaitinfo(), so none can slip in before it blocks
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &signals, &workerMask);
+    fprintf(stderr, "sc_opt server listening on %s with %ld workers\n", socketPath, workers);
+
+    int status = 0;
+    while (1) {
+        int alive = 0;
+        for (long i = 0; i < workers; i++) {
+            if (pids[i] <= 0) pids[i] = startWorker(fd, &workerMask);
+            if (pids[i] > 0) alive++;
+        }
+        if (alive == 0) {
+            status = 2;
+            break;
+        }
+        int sig = sigwaitinfo(&signals, NULL);
+        if (sig == SIGINT || sig == SIGTERM) break;
+        int exitStatus, died = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &exitStatus, WNOHANG)) > 0) {
+            for (long i = 0; i < workers; i++) {
+                if (pids[i] == pid) pids[i] = 0;
+            }
+            if (WIFSIGNALED(exitStatus)) fprintf(stderr, "sc_opt server: worker %d killed by signal %d, starting a new one\n", (int)pid, WTERMSIG(exitStatus));
+            else fprintf(stderr, "sc_opt server: worker %d exited, starting a new one\n", (int)pid);
+            died = 1;
+        }
+        if (died) sleep(1); // A worker that dies at once must not turn this loop into a fork bomb
+    }
+    for (long i = 0; i < workers; i++) {
+        if (pids[i] > 0) kill(pids[i], SIGTERM); // Idle ones exit, busy ones finish the request they are on
+    }
+    for (long i = 0; i < workers; i++) {
+        if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+    }
+    free(pids);
+    close(fd);
+    unlink(socketPath);
+    return status;
+}
+
+// Connects and waits for a worker to accept, -1 if there is no server or every worker stayed busy for ACCEPT_WAIT_MS
+static int connectToWorker(const char* socketPath) {
+    int fd = connectTo(socketPath);
+    if (fd < 0) return -1;
+    struct pollfd ready = { .fd = fd, .events = POLLIN };
+    char accepted = 0;
+    int polled;
+    do polled = poll(&ready, 1, ACCEPT_WAIT_MS); while (polled < 0 && errno == EINTR);
+    if (polled <= 0 || readAll(fd, &accepted, 1) || accepted != ACCEPTED) {
+        close(fd); // A worker that takes the connection later reads EOF and moves on, nothing was sent
+        return -1;
+    }
+    return fd;
+}
+
+int sendRequest(const char* socketPath, int argc, char** argv) {
+    int fd = connectToWorker(socketPath);
+    if (fd < 0) { // No server or no free worker, compile here
+        char** args = malloc((argc + 2) * sizeof(char*));
+        if (!args) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 1;
+        }
+        args[0] = "sc_opt";
+        memcpy(args + 1, argv, argc * sizeof(char*));
+        args[argc + 1] = NULL;
+        int status = compileCommand(argc + 1, args);
+        free(args);
+        return status;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "Error reading the current directory: %s\n", strerror(errno));
+        close(fd);
+        return 2;
+    }
+    size_t length = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) length += strlen(argv[i]) + 1;
+    if (length > MAX_REQUEST_BYTES) {
+        fprintf(stderr, "Command line too long for the server\n");
+        close(fd);
+        return 2;
+    }
+    char* payload = malloc(length);
+    if (!payload) {
+        fprintf(stderr, "Memory allocation failed\n");
+        close(fd);
+        return 1;
+    }
+    size_t offset = 0;
+    memcpy(payload, cwd, strlen(cwd) + 1);
+    offset += strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) {
+        memcpy(payload + offset, argv[i], strlen(argv[i]) + 1);
+        offset += strlen(argv[i]) + 1;
+    }
+
+    fflush(stdout); fflush(stderr);
+    struct RequestHeader header = { .magic = REQUEST_MAGIC, .argCount = argc, .length = length };
+    int fds[REQUEST_FDS] = { 0, 1, 2 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    int32_t exitCode;
+    int failed = sendmsg(fd, &msg, 0) != (ssize_t)sizeof(header) || writeAll(fd, payload, length) || readAll(fd, &exitCode, sizeof(exitCode));
+    free(payload);
+    close(fd);
+    if (failed) {
+        fprintf(stderr, "Lost the connection to the server on %s\n", socketPath);
+        return 2;
+    }
+    return exitCode;
+}
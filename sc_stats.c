@@ -0,0 +1,218 @@
+/* Instrumentation:
+ * Per phase wall time, run counts and allocations, plus a few global counters (files, bytes, tokens, nodes).
+ * Each thread counts into its own threadStats with no locking, statsFlush() adds them to the process totals when a file is done.
+ * A phase costs two clock reads, cheap enough to leave on (-ftime-report / --stats-json only decide whether the totals get printed).
+ *
+ * Tracing (--trace): every closed phase is also recorded as a span in a per-thread event buffer, only the owning thread writes to it.
+ * The only lock is taken once per thread, to register its buffer. traceWrite() dumps all buffers as Chrome trace-event JSON
+ * (chrome://tracing, ui.perfetto.dev), one track per worker thread.
+*/
+#include <time.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "sc_token.h"
+
+const char* phaseNames[PHASE_COUNT] = { "read", "lex", "parse", "inline", "fold", "dce", "licm", "strength-reduce", "ive", "unroll", "image" };
+int statsEnabled = 0;
+_Thread_local struct Stats threadStats;
+static struct Stats totals;
+static pthread_mutex_t totalsLock = PTHREAD_MUTEX_INITIALIZER;
+
+struct TraceEvent {
+    const char* name; // Static string (phase name)
+    const char* file; // Input being compiled, NULL if none
+    uint64_t start, end;
+};
+
+struct TraceBuffer {
+    struct TraceEvent* events;
+    size_t count;
+    size_t capacity;
+    int tid;
+    struct TraceBuffer* next; // Registered buffers, newest first
+};
+
+int traceEnabled = 0;
+static _Thread_local struct TraceBuffer* traceBuffer;
+_Thread_local const char* currentFile; // Input this thread is compiling, tags trace spans and remarks
+static struct TraceBuffer* traceBuffers;
+static uint64_t traceOrigin;
+static int traceThreads;
+
+uint64_t statsNow(void) {
+    if (!statsEnabled) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Close a phase opened with start = statsNow()
+void statsEnd(enum Phase phase, uint64_t start) {
+    if (!statsEnabled) return;
+    uint64_t end = statsNow();
+    threadStats.phase[phase].nanos += end - start;
+    threadStats.phase[phase].runs++;
+    if (traceEnabled) traceSpan(phaseNames[phase], start, end);
+}
+
+void traceBegin(void) {
+    traceEnabled = 1;
+    statsEnabled = 1;
+    traceOrigin = statsNow();
+}
+
+// Tag this thread's following spans and remarks with the file being compiled
+void statsSetFile(const char* fileName) {
+    currentFile = fileName;
+}
+
+void traceSpan(const char* name, uint64_t start, uint64_t end) {
+    struct TraceBuffer* tbuf = traceBuffer;
+    if (!tbuf) {
+        tbuf = calloc(1, sizeof(struct TraceBuffer));
+        if (!tbuf) return;
+        pthread_mutex_lock(&totalsLock);
+        tbuf->tid = ++traceThreads;
+        tbuf->next = traceBuffers;
+        traceBuffers = tbuf;
+        pthread_mutex_unlock(&totalsLock);
+        traceBuffer = tbuf;
+    }
+    if (tbuf->count == tbuf->capacity) {
+        size_t capacity = tbuf->capacity ? tbuf->capacity * 2 : 256;
+        struct TraceEvent* temp = realloc(tbuf->events, capacity * sizeof(struct TraceEvent));
+        if (!temp) return; // Drop the event rather than fail the compile
+        tbuf->events = temp;
+        tbuf->capacity = capacity;
+    }
+    struct TraceEvent event = { .name = name, .file = currentFile, .start = start, .end = end };
+    tbuf->events[tbuf->count++] = event;
+}
+
+void writeJsonString(FILE* out, const char* str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') fputc('\\', out);
+        if ((unsigned char)*str < 0x20) fprintf(out, "\\u%04x", *str);
+        else fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+// Drops every recorded span. Their file tags point into the batch's options, so no span may outlive the batch
+static void traceFree(void) {
+    struct TraceBuffer* tbuf = traceBuffers;
+    while (tbuf) {
+        struct TraceBuffer* next = tbuf->next;
+        free(tbuf->events);
+        free(tbuf);
+        tbuf = next;
+    }
+    traceBuffers = NULL;
+    traceBuffer = NULL; // Freed above, the other threads that had one have exited
+    traceThreads = 0;
+}
+
+// Call after all workers have joined. The spans are freed whether or not the file could be written
+int traceWrite(const char* fileName) {
+    FILE* out = fopen(fileName, "w");
+    if (!out) {
+        fprintf(stderr, "Error opening trace file %s\n", fileName);
+        traceFree();
+        return -1;
+    }
+    fprintf(out, "{\"traceEvents\":[\n");
+    int first = 1;
+    struct TraceBuffer* tbuf = traceBuffers;
+    while (tbuf) {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", first ? "" : ",\n", tbuf->tid, tbuf->tid - 1);
+        first = 0;
+        for (size_t i = 0; i < tbuf->count; i++) {
+            struct TraceEvent* ev = &tbuf->events[i];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", ev->name, tbuf->tid,
+                    (ev->start - traceOrigin) / 1e3, (ev->end - ev->start) / 1e3);
+            if (ev->file) { fprintf(out, ",\"args\":{\"file\":"); writeJsonString(out, ev->file); fprintf(out, "}"); }
+            fprintf(out, "}");
+        }
+        tbuf = tbuf->next;
+    }
+    fprintf(out, "\n]}\n");
+    traceFree();
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Back to the startup state, for a process that runs more than one batch (--serve)
+void statsReset(void) {
+    struct Stats empty = { 0 };
+    pthread_mutex_lock(&totalsLock);
+    totals = empty;
+    pthread_mutex_unlock(&totalsLock);
+    threadStats = empty;
+    statsEnabled = 0;
+    traceEnabled = 0;
+    traceFree(); // Normally empty already, traceWrite() frees what it wrote
+    currentFile = NULL;
+}
+
+// Every malloc/calloc/realloc of compiler data (source, tokens, literal pool, token image) is counted in the phase that makes it,
+// a realloc as an allocation of its new size. The trace buffers are the instrumentation's own and are not counted.
+void statsAlloc(enum Phase phase, size_t bytes) {
+    threadStats.phase[phase].allocBytes += bytes;
+    threadStats.phase[phase].allocCount++;
+}
+
+void statsFlush(void) {
+    pthread_mutex_lock(&totalsLock);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        totals.phase[p].nanos += threadStats.phase[p].nanos;
+        totals.phase[p].runs += threadStats.phase[p].runs;
+        totals.phase[p].allocBytes += threadStats.phase[p].allocBytes;
+        totals.phase[p].allocCount += threadStats.phase[p].allocCount;
+    }
+    totals.files += threadStats.files;
+    totals.srcBytes += threadStats.srcBytes;
+    totals.tokens += threadStats.tokens;
+    totals.nodesCreated += threadStats.nodesCreated;
+    totals.nodesEliminated += threadStats.nodesEliminated;
+    pthread_mutex_unlock(&totalsLock);
+
+    struct Stats empty = { 0 };
+    threadStats = empty;
+}
+
+// Phases that never ran are left out. Times are summed over threads, so under -j they can add up to more than the wall time.
+void statsReport(FILE* out, int json) {
+    uint64_t totalNanos = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) totalNanos += totals.phase[p].nanos;
+
+    if (json) {
+        fprintf(out, "{\n  \"files\": %llu, \"srcBytes\": %llu, \"tokens\": %llu, \"nodesCreated\": %llu, \"nodesEliminated\": %llu,\n  \"phases\": [",
+                (unsigned long long)totals.files, (unsigned long long)totals.srcBytes, (unsigned long long)totals.tokens,
+                (unsigned long long)totals.nodesCreated, (unsigned long long)totals.nodesEliminated);
+        int first = 1;
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            struct PhaseStats* ps = &totals.phase[p];
+            if (!ps->runs) continue;
+            fprintf(out, "%s\n    { \"name\": \"%s\", \"nanos\": %llu, \"runs\": %llu, \"allocBytes\": %llu, \"allocCount\": %llu }", first ? "" : ",",
+                    phaseNames[p], (unsigned long long)ps->nanos, (unsigned long long)ps->runs, (unsigned long long)ps->allocBytes, (unsigned long long)ps->allocCount);
+            first = 0;
+        }
+        fprintf(out, "\n  ]\n}\n");
+        return;
+    }
+
+    fprintf(out, "===-------------------------------------------------------------===\n");
+    fprintf(out, "  %llu files, %llu bytes, %llu tokens, %llu nodes created, %llu eliminated\n",
+            (unsigned long long)totals.files, (unsigned long long)totals.srcBytes, (unsigned long long)totals.tokens,
+            (unsigned long long)totals.nodesCreated, (unsigned long long)totals.nodesEliminated);
+    fprintf(out, "===-------------------------------------------------------------===\n");
+    fprintf(out, "  %-16s %12s %7s %8s %14s %10s\n", "Phase", "Time (ms)", "%", "Runs", "Alloc bytes", "Allocs");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        struct PhaseStats* ps = &totals.phase[p];
+        if (!ps->runs) continue;
+        fprintf(out, "  %-16s %12.3f %6.1f%% %8llu %14llu %10llu\n", phaseNames[p], ps->nanos / 1e6,
+                totalNanos ? 100.0 * ps->nanos / totalNanos : 0.0, (unsigned long long)ps->runs,
+                (unsigned long long)ps->allocBytes, (unsigned long long)ps->allocCount);
+    }
+    fprintf(out, "  %-16s %12.3f\n", "Total", totalNanos / 1e6);
+}
@@ -1,4 +1,8 @@
 #include <stdio.h>
+#include <stdint.h>
+
+#define SC_VERSION "0.1"
+#define FNV_OFFSET 14695981039346656037ULL
 
 // Token types
 enum TokenType {
@@ -24,6 +28,18 @@ struct Token {
     char* lexeme; // Start of token
     int line, col; // line/col for error reporting
     int length; // Length of token (end = length - start)
+    int literalId; // STR_LITERAL: id in the TokenBuffer's literal pool
+};
+
+// Decoded string literals, one copy per distinct content (escapes decoded once at lex time)
+struct LiteralPool {
+    char* data; // Decoded bytes, each literal followed by '\0'
+    size_t dataSize, dataCapacity;
+    size_t* offsets; // Literal id -> offset into data
+    int* lengths; // Literal id -> decoded length (can contain '\0')
+    int count, capacity;
+    int* table; // Hash table of id + 1 by content, 0 = empty slot
+    size_t tableSize;
 };
 
 // TokenBuffer (tb) struct
@@ -32,10 +48,166 @@ struct TokenBuffer {
     size_t count; // Current number of tokens in buf
     size_t capacity; // Capacity of buf (default = 128)
     char* src; // For storing buf allocated in sc_lexer.c
+    struct LiteralPool literals; // String literals referenced by STR_LITERAL tokens
 };
 
 // Declare lexFile() so it can be seen across files
 struct TokenBuffer lexFile(char* fileName);
+void prefetchFile(const char* fileName);
+struct TokenBuffer relexEdit(struct TokenBuffer* old, size_t offset, size_t removed, const char* inserted, size_t insertedLength);
+unsigned long long hashBytes(const char* bytes, size_t length, unsigned long long seed);
+unsigned long long sourceHash(const struct TokenBuffer* tb);
+const char* literalText(const struct LiteralPool* pool, int id, int* length);
+void freeLiterals(struct LiteralPool* pool);
+
+// Binary token image (sc_image.c): offsets instead of pointers so a loaded file is used in place, with no per-token fixups
+#define SC_IMAGE_MAGIC 0x4B544353u // "SCTK"
+#define SC_IMAGE_VERSION 3
+#define NO_LEXEME UINT32_MAX
+
+enum ImageSection {
+    SECTION_SRC, // Source bytes + '\0'
+    SECTION_TOKENS, // PackedToken array
+    SECTION_LITERAL_INDEX, // PackedLiteral per literal id
+    SECTION_LITERAL_DATA // Decoded literal bytes
+};
+
+struct ImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sectionCount; // Entries in the section table that follows the header
+    uint32_t reserved;
+    uint64_t checksum; // hashBytes() over cacheKey and the section table
+    uint64_t cacheKey; // Passed to writeTokenImage(), sourceHash() chained with the options that affect the output
+};
+
+struct ImageSectionEntry {
+    uint32_t kind; // enum ImageSection
+    uint32_t reserved;
+    uint64_t offset; // From start of file, 8 byte aligned
+    uint64_t size; // In bytes
+    uint64_t checksum; // hashBytes() over the section's bytes, checked when the section is first used
+};
+
+struct PackedToken {
+    float val;
+    int32_t type;
+    uint32_t lexemeOffset; // Offset into SECTION_SRC, NO_LEXEME for EOF
+    int32_t line, col;
+    int32_t length;
+    int32_t literalId;
+};
+
+struct PackedLiteral {
+    uint32_t offset; // Into SECTION_LITERAL_DATA
+    uint32_t length; // Decoded length, the bytes are followed by '\0'
+};
+
+// A loaded image. Loading only reads the header and section table, each section is checked the first time
+// one of the accessors below needs it, and what they return points straight into the mapping.
+struct TokenImage {
+    void* base; // Mapping (or buffer) holding the whole file, NULL if loading failed
+    size_t size;
+    const struct ImageSectionEntry* sections;
+    uint32_t sectionCount;
+    unsigned verified; // Bit per ImageSection kind that passed its checks
+    unsigned long long cacheKey;
+};
+
+int writeTokenImage(const char* fileName, struct TokenBuffer* tb, unsigned long long cacheKey);
+struct TokenImage loadTokenImage(const char* fileName);
+void freeTokenImage(struct TokenImage* image);
+// Accessors return NULL if the section is missing or corrupt
+const char* imageSource(struct TokenImage* image);
+const struct PackedToken* imageTokens(struct TokenImage* image, size_t* count);
+const char* imageLiteral(struct TokenImage* image, int id, int* length);
+
+// Compiler phases for instrumentation (sc_stats.c), PHASE_INLINE..PHASE_UNROLL are the optimization passes in pipeline order
+enum Phase {
+    PHASE_READ,
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_INLINE,
+    PHASE_FOLD,
+    PHASE_DCE,
+    PHASE_LICM,
+    PHASE_STRENGTH_REDUCE,
+    PHASE_IVE,
+    PHASE_UNROLL,
+    PHASE_IMAGE,
+    PHASE_COUNT
+};
+#define PASS_COUNT (PHASE_UNROLL - PHASE_INLINE + 1)
+
+struct PhaseStats {
+    uint64_t nanos; // Wall time spent in the phase
+    uint64_t runs; // Times the phase ran
+    uint64_t allocBytes; // Bytes requested from malloc/realloc
+    uint64_t allocCount;
+};
+
+struct Stats {
+    struct PhaseStats phase[PHASE_COUNT];
+    uint64_t files;
+    uint64_t srcBytes;
+    uint64_t tokens; // Tokens emitted
+    uint64_t nodesCreated; // AST nodes (once the parser builds them)
+    uint64_t nodesEliminated; // AST nodes removed by passes
+};
+
+extern const char* phaseNames[PHASE_COUNT];
+extern int statsEnabled;
+extern _Thread_local struct Stats threadStats; // Current thread's counters, merged by statsFlush()
+uint64_t statsNow(void);
+void statsEnd(enum Phase phase, uint64_t start);
+void statsAlloc(enum Phase phase, size_t bytes);
+void statsFlush(void);
+extern _Thread_local const char* currentFile;
+void statsSetFile(const char* fileName);
+void statsReport(FILE* out, int json);
+void statsReset(void);
+extern int traceEnabled;
+void traceBegin(void);
+void traceSpan(const char* name, uint64_t start, uint64_t end);
+int traceWrite(const char* fileName);
+void writeJsonString(FILE* out, const char* str); // Quoted and escaped, also valid as a YAML double-quoted scalar
+
+// Optimization remarks (sc_remarks.c)
+enum RemarkKind {
+    REMARK_APPLIED, // Transform was done
+    REMARK_MISSED, // Transform was considered and rejected
+    REMARK_ANALYSIS // Information a pass worked out (trip count, cost, ...)
+};
+
+extern unsigned remarkMask; // Bit per Phase whose remarks are wanted, 0 = remarks off
+
+// Check the mask before building any arguments so disabled remarks cost one load and branch
+#define REMARK(pass, kind, function, token, reason, cost, threshold) \
+    do { if (remarkMask & (1u << (pass))) emitRemark(pass, kind, function, token, reason, cost, threshold); } while (0)
+
+int remarksBegin(const char* fileName, const char* passRegex, int json);
+void emitRemark(enum Phase pass, enum RemarkKind kind, const char* function, const struct Token* token, const char* reason, int cost, int threshold);
+int remarksEnd(void);
+
+// Optimization fuel and per function budgets (sc_fuel.c)
+struct Budget {
+    uint64_t deadline; // Monotonic ms, 0 = none
+    size_t maxSize; // IR size limit, 0 = none
+};
+
+extern long budgetMillis;
+extern int budgetGrowth;
+void initFuel(void);
+int setFuel(const char* spec);
+int parseCount(const char* text, long max, long* value);
+int consumeFuel(enum Phase pass);
+struct Budget budgetBegin(size_t size);
+int budgetExceeded(const struct Budget* budget, size_t size);
+
+// Compile server (sc_server.c)
+int compileCommand(int argc, char** argv); // One sc_opt command line (sc_parser.c), returns its exit code
+int serveRequests(const char* socketPath, int argc, char** argv);
+int sendRequest(const char* socketPath, int argc, char** argv);
 
 // Parser struct
 struct Parser {
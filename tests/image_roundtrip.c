@@ -0,0 +1,173 @@
+/* Round-trip test for the token image:
+ * Writes each input's TokenBuffer with writeTokenImage(), loads it back and checks that imageSource(), imageTokens() and
+ * imageLiteral() give exactly what lexFile() built (source, every token field, every string literal) and the cache key.
+ * Then corrupts one byte in each section in turn: loading still succeeds (only the header and section table are read), the
+ * corrupted section's accessor returns NULL and the others still work. A corrupted section table fails the load.
+ * Build: gcc -pthread -o image_roundtrip tests/image_roundtrip.c sc_image.c sc_lexer.c sc_stats.c
+ * Usage: ./image_roundtrip <file.sc>...   (failures on stdout, exit code 1 on any)
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../sc_token.h"
+
+#define TEST_KEY 0x5C1A6E5EEDull
+
+static int sectionUsable(struct TokenImage* image, enum ImageSection kind) {
+    size_t count;
+    int length;
+    if (kind == SECTION_SRC) return imageSource(image) != NULL;
+    if (kind == SECTION_TOKENS) return imageTokens(image, &count) != NULL;
+    return imageLiteral(image, 0, &length) != NULL;
+}
+
+// Number of differences between the loaded image and the buffer it was written from
+static int compareImage(struct TokenImage* image, struct TokenBuffer* tb, const char* fileName) {
+    if (image->cacheKey != TEST_KEY) {
+        printf("%s: cache key %llx, expected %llx\n", fileName, image->cacheKey, TEST_KEY);
+        return 1;
+    }
+    const char* src = imageSource(image);
+    if (!src || strcmp(src, tb->src)) {
+        printf("%s: source differs\n", fileName);
+        return 1;
+    }
+    size_t count;
+    const struct PackedToken* tokens = imageTokens(image, &count);
+    if (!tokens || count != tb->count) {
+        printf("%s: %zu tokens loaded, %zu written\n", fileName, tokens ? count : 0, tb->count);
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const struct PackedToken* p = &tokens[i];
+        struct Token* t = &tb->buf[i];
+        uint32_t offset = t->lexeme ? (uint32_t)(t->lexeme - tb->src) : NO_LEXEME;
+        if (p->type != (int32_t)t->type || p->lexemeOffset != offset || p->line != t->line || p->col != t->col || p->length != t->length ||
+            p->val != t->val || (t->type == STR_LITERAL && p->literalId != t->literalId)) {
+            printf("%s: token %zu differs\n", fileName, i);
+            return 1;
+        }
+    }
+    for (int id = 0; id < tb->literals.count; id++) {
+        int expectedLength, length;
+        const char* expected = literalText(&tb->literals, id, &expectedLength);
+        const char* text = imageLiteral(image, id, &length);
+        if (!text || length != expectedLength || memcmp(text, expected, length) || text[length] != '\0') {
+            printf("%s: literal %d differs\n", fileName, id);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int writeBytes(const char* fileName, const char* bytes, size_t size) {
+    FILE* file = fopen(fileName, "wb");
+    if (!file) return -1;
+    size_t written = fwrite(bytes, 1, size, file);
+    return (fclose(file) == 0 && written == size) ? 0 : -1;
+}
+
+// Flips one byte in each non-empty section and in the section table, returns the number of failures
+static int testCorruption(const char* imageName, const char* corruptName, const char* fileName, int literalCount) {
+    FILE* file = fopen(imageName, "rb");
+    if (!file) return 1;
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    rewind(file);
+    char* bytes = malloc(size);
+    size_t got = bytes ? fread(bytes, 1, size, file) : 0;
+    fclose(file);
+    if (got != size) {
+        free(bytes);
+        printf("%s: could not read the image back\n", fileName);
+        return 1;
+    }
+
+    int failures = 0;
+    struct ImageHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        struct ImageSectionEntry entry;
+        memcpy(&entry, bytes + sizeof(header) + i * sizeof(entry), sizeof(entry));
+        if (!entry.size) continue;
+        size_t at = entry.offset + entry.size / 2;
+        bytes[at] ^= 0x20;
+        struct TokenImage image = writeBytes(corruptName, bytes, size) ? (struct TokenImage){ 0 } : loadTokenImage(corruptName);
+        bytes[at] ^= 0x20;
+        if (!image.base) {
+            printf("%s: image with a corrupt section %u did not load\n", fileName, entry.kind);
+            failures++;
+            continue;
+        }
+        // imageLiteral() uses both literal sections, and needs a literal to look up
+        enum ImageSection checked[] = { SECTION_SRC, SECTION_TOKENS, SECTION_LITERAL_DATA };
+        for (int c = 0; c < (literalCount ? 3 : 2); c++) {
+            enum ImageSection kind = checked[c];
+            int broken = kind == SECTION_LITERAL_DATA ? entry.kind >= SECTION_LITERAL_INDEX : entry.kind == kind;
+            if (sectionUsable(&image, kind) == broken) {
+                printf("%s: corrupt section %u, section %d %s\n", fileName, entry.kind, kind, broken ? "was accepted" : "was rejected");
+                failures++;
+            }
+        }
+        freeTokenImage(&image);
+    }
+
+    bytes[sizeof(header)] ^= 0x01; // First section's kind, covered by the header checksum
+    struct TokenImage image = writeBytes(corruptName, bytes, size) ? (struct TokenImage){ 0 } : loadTokenImage(corruptName);
+    if (image.base) {
+        printf("%s: image with a corrupt section table loaded\n", fileName);
+        freeTokenImage(&image);
+        failures++;
+    }
+    free(bytes);
+    return failures;
+}
+
+static int testFile(const char* fileName, const char* imageName, const char* corruptName) {
+    struct TokenBuffer tb = lexFile((char*)fileName);
+    if (!tb.buf) {
+        printf("%s: could not be lexed\n", fileName);
+        return 1;
+    }
+    int failures = 0;
+    if (writeTokenImage(imageName, &tb, TEST_KEY)) {
+        printf("%s: writeTokenImage failed\n", fileName);
+        failures++;
+    }
+    else {
+        struct TokenImage image = loadTokenImage(imageName);
+        if (!image.base) {
+            printf("%s: loadTokenImage failed\n", fileName);
+            failures++;
+        }
+        else {
+            failures += compareImage(&image, &tb, fileName);
+            freeTokenImage(&image);
+            failures += testCorruption(imageName, corruptName, fileName, tb.literals.count);
+        }
+    }
+    free(tb.buf); free(tb.src); freeLiterals(&tb.literals);
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file.sc>...\n", argv[0]);
+        return 2;
+    }
+    char imageName[] = "/tmp/image_roundtrip_XXXXXX";
+    char corruptName[] = "/tmp/image_corrupt_XXXXXX";
+    int imageFd = mkstemp(imageName), corruptFd = mkstemp(corruptName);
+    if (imageFd < 0 || corruptFd < 0) {
+        fprintf(stderr, "Could not create a temp file\n");
+        return 2;
+    }
+    close(imageFd); close(corruptFd);
+    if (!freopen("/dev/null", "w", stderr)) return 2; // The loader reports the corrupt images on stderr, they are expected here
+
+    int failures = 0;
+    for (int i = 1; i < argc; i++) failures += testFile(argv[i], imageName, corruptName);
+    unlink(imageName); unlink(corruptName);
+    printf("%d file(s), %d failure(s)\n", argc - 1, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/* Differential test for relexEdit():
+ * Applies random edits to each input and checks that relexEdit() gives exactly the tokens lexFile() gives for the edited text
+ * (type, lexeme offset, length, line, col, val and decoded string literals) and that its literal pool is the one lexFile() builds,
+ * so strings removed by an edit don't stay in the pool. Edits are chained like keystrokes in an editor,
+ * every CHAIN_LENGTH edits the chain starts over from the original file.
+ * Build: gcc -pthread -o relex_diff tests/relex_diff.c sc_lexer.c sc_stats.c
+ * Usage: ./relex_diff [-n edits per file] [-s seed] <file.sc>...   (mismatches on stdout, exit code 1 on any)
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../sc_token.h"
+
+#define CHAIN_LENGTH 50
+#define MAX_REPORTED 5
+
+// Insertions that open and close calls, arrays, strings, chars and comments as well as plain tokens
+static const char* snippets[] = { "x", " ", "\n", ";", "a+b", "(", ")", "f(y)", "g(", "[2]", "[", "]", "9", "1.5", "=", "==", "/", "//", "/*", "*/",
+                                  "\"", "\"s\"", "\"\\n\"", "'", "'c'", "\\", "int ", "return ", "{", "}", ",", "h(1, \"q)\")" };
+static const int snippetCount = sizeof(snippets) / sizeof(snippets[0]);
+
+static void freeBuffer(struct TokenBuffer* tb) {
+    free(tb->buf); free(tb->src); freeLiterals(&tb->literals);
+    tb->buf = NULL; tb->src = NULL;
+}
+
+static struct TokenBuffer lexText(const char* text, const char* tmpName) {
+    FILE* file = fopen(tmpName, "w");
+    fputs(text, file);
+    fclose(file);
+    return lexFile((char*)tmpName);
+}
+
+// Index of the first differing token, -1 if the buffers match
+static long compareTokens(struct TokenBuffer* relexed, struct TokenBuffer* full) {
+    if (!relexed->buf || !full->buf) return (!relexed->buf && !full->buf) ? -1 : 0;
+    if (strcmp(relexed->src, full->src)) return 0;
+    for (size_t i = 0; i < relexed->count || i < full->count; i++) {
+        if (i >= relexed->count || i >= full->count) return i;
+        struct Token* a = &relexed->buf[i];
+        struct Token* b = &full->buf[i];
+        if (a->type != b->type || a->length != b->length || a->line != b->line || a->col != b->col || a->val != b->val) return i;
+        if ((a->lexeme ? a->lexeme - relexed->src : -1) != (b->lexeme ? b->lexeme - full->src : -1)) return i;
+        if (a->type == STR_LITERAL) {
+            int lengthA, lengthB;
+            const char* textA = literalText(&relexed->literals, a->literalId, &lengthA);
+            const char* textB = literalText(&full->literals, b->literalId, &lengthB);
+            if (lengthA != lengthB || memcmp(textA, textB, lengthA)) return i;
+        }
+    }
+    if (relexed->literals.count != full->literals.count || relexed->literals.dataSize != full->literals.dataSize) return relexed->count;
+    return -1;
+}
+
+static void printToken(const char* label, struct TokenBuffer* tb, long index) {
+    if (!tb->buf || (size_t)index >= tb->count) {
+        if (tb->buf) printf("    %s: (no token, %d literals in %zu bytes)\n", label, tb->literals.count, tb->literals.dataSize);
+        else printf("    %s: (failed)\n", label);
+        return;
+    }
+    struct Token* t = &tb->buf[index];
+    printf("    %s: type %d '%.*s' at %d:%d (%zu tokens)\n", label, t->type, t->lexeme ? t->length : 0, t->lexeme ? t->lexeme : "", t->line, t->col, tb->count);
+}
+
+// Runs `edits` random edits on one file, returns the number of mismatches
+static int testFile(const char* fileName, int edits, const char* tmpName) {
+    struct TokenBuffer original = lexFile((char*)fileName);
+    if (!original.buf) {
+        printf("%s: could not be lexed\n", fileName);
+        return 1;
+    }
+
+    int mismatches = 0;
+    struct TokenBuffer current = { 0 };
+    for (int edit = 0; edit < edits; edit++) {
+        if (edit % CHAIN_LENGTH == 0 || !current.buf) {
+            freeBuffer(&current);
+            current = lexText(original.src, tmpName);
+        }
+        size_t length = strlen(current.src);
+        size_t offset = rand() % (length + 1);
+        size_t removed = rand() % 3 == 0 ? rand() % 6 : 0;
+        if (removed > length - offset) removed = length - offset;
+        const char* inserted = rand() % 4 == 0 ? "" : snippets[rand() % snippetCount];
+        if (!removed && !*inserted) inserted = snippets[rand() % snippetCount];
+
+        char* text = malloc(length - removed + strlen(inserted) + 1);
+        memcpy(text, current.src, offset);
+        strcpy(text + offset, inserted);
+        strcat(text, current.src + offset + removed);
+        struct TokenBuffer full = lexText(text, tmpName);
+        current = relexEdit(&current, offset, removed, inserted, strlen(inserted)); // A failed relex (NULL buf) restarts the chain
+        free(text);
+
+        long index = compareTokens(&current, &full);
+        if (index >= 0) {
+            if (mismatches++ < MAX_REPORTED) {
+                printf("%s: edit %d (offset %zu, removed %zu, inserted \"%s\") differs at token %ld\n", fileName, edit, offset, removed, inserted, index);
+                printToken("relexEdit", &current, index);
+                printToken("lexFile  ", &full, index);
+            }
+            freeBuffer(&current);
+        }
+        freeBuffer(&full);
+    }
+    freeBuffer(&current);
+    freeBuffer(&original);
+    return mismatches;
+}
+
+int main(int argc, char** argv) {
+    int edits = 2000;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        if (opt == 'n') edits = atoi(optarg);
+        else if (opt == 's') seed = (unsigned)atoi(optarg);
+        else return 2;
+    }
+    if (optind == argc) {
+        fprintf(stderr, "Usage: %s [-n edits per file] [-s seed] <file.sc>...\n", argv[0]);
+        return 2;
+    }
+    srand(seed);
+
+    char tmpName[] = "/tmp/relex_diff_XXXXXX";
+    int fd = mkstemp(tmpName);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create a temp file\n");
+        return 2;
+    }
+    close(fd);
+    if (!freopen("/dev/null", "w", stderr)) return 2; // The lexer reports broken edits on stderr, they are expected here, mismatches go to stdout
+
+    int mismatches = 0;
+    for (int i = optind; i < argc; i++) mismatches += testFile(argv[i], edits, tmpName);
+    unlink(tmpName);
+    printf("%d edits per file, %d file(s), %d mismatch(es)\n", edits, argc - optind, mismatches);
+    return mismatches ? 1 : 0;
+}